@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Journal.h"
+#include "Http.h"
+
+namespace blastic {
+
+namespace uploader {
+
+// most submissions in a single request
+constexpr const size_t maxBatch = 32;
+
+// configuration of an endpoint, stored in Submitter::EEPROMConfig
+struct [[gnu::packed]] Endpoint {
+  // NONE disables the endpoint, FORM posts each submission as a form, BATCH posts batches of JSON lines
+  enum class Backend : uint8_t { NONE, FORM, BATCH };
+  Backend backend;
+  // host followed by the path, without the scheme (always https)
+  char urn[128];
+  // FORM: names of the form fields
+  struct FormFields {
+    char type[32], collectionPoint[32], collectorName[32], weight[32];
+  } form;
+  // BATCH: post when maxRecords are pending, when the oldest is maxAge seconds old, or when the scale goes idle
+  struct [[gnu::packed]] BatchParameters {
+    uint8_t maxRecords;
+    uint16_t maxAge;
+  } batch;
+};
+
+// the device side of the submissions, the strings are read at each use so they follow configuration changes
+struct Identity {
+  const char *collectionPoint, *collectorName, *userAgent;
+};
+
+/*
+  A backend decides how many submissions go in a request to an endpoint, and encodes them as the request body. The
+  uploader takes care of the journal, the connections and the retries. There are no dependencies on the Arduino core,
+  so the backends can be exercised on the host.
+*/
+class Backend {
+public:
+  explicit Backend(const Identity &identity) : identity(identity) {}
+  virtual const char *contentType() const = 0;
+  // sanity check of the endpoint configuration, before anything is sent
+  virtual bool configured(const Endpoint &endpoint) const = 0;
+  /*
+    How many of the pending submissions to send now (at most maxBatch), oldestAge is the age in seconds of the oldest
+    one (UINT32_MAX if created before this boot). If 0, the uploader tries again after waitSeconds, or when woken.
+  */
+  virtual size_t ready(const Endpoint &endpoint, size_t pending, uint32_t oldestAge, bool flush,
+                       uint32_t &waitSeconds) const = 0;
+  // returns false if the submissions do not fit in the body, now is in seconds since boot as Submission::seconds
+  virtual bool encode(const Endpoint &endpoint, const journal::Submission *submissions, size_t n, uint32_t now,
+                      util::http::Writer &body) const = 0;
+
+protected:
+  const Identity &identity;
+};
+
+// one form post per submission, with the field names in endpoint.form (e.g. the Google Forms setup)
+class FormBackend : public Backend {
+public:
+  using Backend::Backend;
+  const char *contentType() const override { return "application/x-www-form-urlencoded"; }
+  bool configured(const Endpoint &endpoint) const override;
+  size_t ready(const Endpoint &endpoint, size_t pending, uint32_t oldestAge, bool flush,
+               uint32_t &waitSeconds) const override;
+  bool encode(const Endpoint &endpoint, const journal::Submission *submissions, size_t n, uint32_t now,
+              util::http::Writer &body) const override;
+};
+
+/*
+  Batches of submissions as JSON lines. The first line has the fields common to all the records, then there is a line
+  per submission:
+
+    {"device":"blastic-scale/...","collectionPoint":"...","collector":"..."}
+    {"id":12,"plastic":2,"type":"HDPE","weight":1.56,"age":40}
+
+  id is the journal serial, unique per device, so that the server can discard the duplicates of a batch retried after
+  a lost response. age is in seconds since the weighing, and it is missing if the weighing happened before a reboot.
+*/
+class BatchBackend : public Backend {
+public:
+  using Backend::Backend;
+  const char *contentType() const override { return "application/x-ndjson"; }
+  bool configured(const Endpoint &endpoint) const override;
+  size_t ready(const Endpoint &endpoint, size_t pending, uint32_t oldestAge, bool flush,
+               uint32_t &waitSeconds) const override;
+  bool encode(const Endpoint &endpoint, const journal::Submission *submissions, size_t n, uint32_t now,
+              util::http::Writer &body) const override;
+};
+
+/*
+  Encode the first n submissions in body, halving n until they fit; the rest go in the next request. Returns how many
+  were encoded, 0 if not even one fits.
+*/
+size_t encodeFitting(const Backend &backend, const Endpoint &endpoint, const journal::Submission *submissions,
+                     size_t n, uint32_t now, util::http::Writer &body);
+
+} // namespace uploader
+
+} // namespace blastic
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <Arduino_FreeRTOS.h>
+
+namespace blastic {
+
+namespace scale {
+
+/*
+  Checkweigher segments a stream of weights, taken at the full output rate while items pass over the scale (a chute or
+  a short conveyor), into items.
+
+  While idle, the baseline follows the weight slowly. An item starts when the weight rises trigger above the baseline,
+  and ends when it falls back below half of that. The item weight is the mean of its plateau, the longest run of
+  samples whose spread (max - min) is within plateauBand, minus the baseline. Items with a plateau shorter than
+  minPlateauSamples are still reported, but not marked stable. If an item lasts more than capacity samples only the
+  newest ones are kept for the plateau search.
+
+  The class only depends on the weight and tick values, so it can be fed recorded or synthetic traces.
+*/
+
+class Checkweigher {
+public:
+  struct [[gnu::packed]] EEPROMConfig {
+    // in weight units
+    float trigger, plateauBand;
+    uint8_t minPlateauSamples;
+  };
+
+  struct Item {
+    uint32_t sequence;
+    TickType_t start, end;
+    float weight;
+    // samples above the trigger, and samples in the plateau
+    uint16_t samples, plateauSamples;
+    bool stable;
+  };
+
+  static constexpr const size_t capacity = 64;
+
+  // returns true when an item has been completed, see item()
+  bool update(const EEPROMConfig &config, float weight, TickType_t tick);
+  void reset();
+
+  bool inItem() const { return active; }
+  float baseline() const { return baselineWeight; }
+  const Item &item() const { return lastItem; }
+
+protected:
+  float weights[capacity];
+  size_t size = 0, next = 0;
+  bool active = false, hasBaseline = false;
+  float baselineWeight = 0;
+  uint32_t sequence = 0;
+  uint16_t samples = 0;
+  TickType_t startTick = 0, lastTick = 0;
+  Item lastItem{};
+
+  size_t index(size_t i) const { return (next + capacity - size + i) % capacity; }
+  void finish(const EEPROMConfig &config);
+};
+
+} // namespace scale
+
+} // namespace blastic
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <Arduino_FreeRTOS.h>
+#include "Journal.h"
+#include "Http.h"
+#include "Backends.h"
+
+namespace blastic {
+
+namespace uploader {
+
+constexpr const uint32_t minBackoff = 5, maxBackoff = 600;
+
+// statuses of failures before a valid HTTP response, otherwise the HTTP status code
+constexpr const int wifiError = -100, tlsError = -101, configError = -102, responseError = -103;
+
+struct Stats {
+  uint32_t uploaded, dropped, failures;
+  // TLS handshakes, and posts on an already open connection
+  uint32_t handshakes, reuses;
+  // requests sent
+  uint32_t requests;
+  int lastStatus;
+  // current retry delay, 0 if not failing
+  uint32_t backoff;
+  // milliseconds from the type selection to the delivery of the last submission, 0 if not known
+  uint32_t latency;
+};
+
+/*
+  The connection of an endpoint to its server: a blastic::WiFiSSLClient on the board, a stand-in server in the native
+  tests. read() returns 0 when nothing is available yet, and a negative value on error.
+*/
+class Transport {
+public:
+  virtual bool connect(const char *host, uint16_t port) = 0;
+  virtual bool connected() = 0;
+  virtual size_t write(const uint8_t *data, size_t size) = 0;
+  virtual int read(uint8_t *data, size_t size) = 0;
+  virtual void stop() = 0;
+};
+
+/*
+  Delivery of the journal to the endpoints, with a connection and a delivery state per endpoint: the requests to the
+  endpoints are sent back to back, and the responses are read as they come, so a slow endpoint does not hold up the
+  others. The submissions are acked in the journal for an endpoint on a 2xx response, or dropped on a 4xx response that
+  retrying cannot fix. On any other failure the endpoint is retried with an exponential backoff, from minBackoff up to
+  maxBackoff seconds, or earlier when woken.
+
+  The connection is kept open across posts, since the TLS handshake over the modem link is the largest cost of a
+  submission. It is reused only if the previous response was read completely, the server did not ask to close it, and
+  the transport still reports it as connected.
+
+  There are no dependencies on the Arduino core or on the WiFi connection: the uploader task brings up WiFi around
+  deliver() and warmUp(), and prints the debug output.
+*/
+class Fanout {
+public:
+  Fanout(const Endpoint (&endpoints)[journal::maxEndpoints], const Identity &identity,
+         Transport *const (&transports)[journal::maxEndpoints]);
+
+  // the enabled and configured endpoints, as a bit mask
+  uint8_t active() const;
+  // ticks until the next scheduled check of an endpoint, portMAX_DELAY if none
+  TickType_t nextCheck() const;
+  // the endpoints that should send now, checked before bringing up WiFi: their schedule expired, or woken
+  uint8_t due(bool woken);
+  // WiFi is not available, fail the endpoints in wanting with status
+  void fail(uint8_t wanting, int status);
+  /*
+    Send to the endpoints in wanting, then read the responses as they come, sending the next request of an endpoint as
+    soon as the previous one is done. Returns when no request is in flight and no endpoint is due.
+  */
+  void deliver(uint8_t wanting);
+  // open the connections to the active endpoints that are not already connected
+  void warmUp();
+  // close all the connections, e.g. because WiFi is about to be brought down
+  void disconnectAll();
+
+  // send the submissions held by a batching backend at the next check, from any task
+  void flush() { flushRequested = (1 << journal::maxEndpoints) - 1; }
+  // a new submission was appended to the journal, to time its delivery, from any task
+  void submitted(uint32_t serial, TickType_t tick);
+  Stats stats(uint8_t endpoint) const { return deliveries[endpoint].stats; }
+
+protected:
+  // debug output, the dropped submissions are reported even when not debugging
+  virtual bool debugging() const { return false; }
+  virtual void print(const char *, size_t) const {}
+
+private:
+  static constexpr const uint32_t responseTimeout = 30000, pollMillis = 10;
+  static constexpr const uint16_t httpsPort = 443;
+
+  struct Delivery {
+    Transport *transport;
+    decltype(Endpoint::urn) host = "";
+    bool reusable = false, reused = false, retried = false;
+    // the submissions of the current request
+    uint32_t firstSerial = 0, lastSerial = 0;
+    size_t n = 0;
+    // a request has been sent and the response is being read
+    bool inFlight = false;
+    TickType_t sentTick = 0;
+    util::http::ResponseParser response;
+    // time of the next check of the endpoint, meaningful only if scheduled
+    bool scheduled = true;
+    TickType_t nextAttempt = 0;
+    Stats stats{};
+  } deliveries[journal::maxEndpoints];
+
+  const Endpoint (&endpoints)[journal::maxEndpoints];
+  const Identity &identity;
+  const FormBackend form;
+  const BatchBackend batch;
+  // endpoints that should send the submissions held by their backend, cleared when they have nothing pending
+  std::atomic<uint8_t> flushRequested{0};
+  // the last submission and when it was appended, to time its delivery (access in a critical section)
+  struct {
+    uint32_t serial = 0;
+    TickType_t tick = 0;
+  } lastSubmission;
+  // the submissions to send, filled by ready() for the request started right after
+  journal::Submission submissions[maxBatch];
+
+  [[gnu::format(printf, 3, 4)]] void log(bool always, const char *format, ...) const;
+  const Backend *backend(uint8_t endpoint) const;
+  void disconnect(Delivery &delivery);
+  bool connect(Delivery &delivery, const char *host);
+  bool eligible(uint8_t endpoint, bool woken) const;
+  size_t ready(uint8_t endpoint);
+  void finish(uint8_t endpoint, int status, uint8_t &wanting);
+  void start(uint8_t endpoint, size_t n, uint8_t &wanting);
+  bool poll(uint8_t endpoint, uint8_t &wanting);
+};
+
+} // namespace uploader
+
+} // namespace blastic
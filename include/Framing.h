@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace util {
+
+/*
+  Building blocks for compact binary records: zigzag + LEB128 varints for (delta encoded) integers, CRC-16/CCITT, and
+  COBS framing, so that a 0 byte always marks the end of a frame and a receiver can resynchronize after garbage or
+  interleaved text. There are no dependencies on the Arduino core, this header is also used by the host tools.
+
+  Encoders write to a caller provided buffer and return the number of bytes written. Decoders return 0 on malformed or
+  truncated input.
+*/
+
+constexpr const size_t maxVarintSize = 5;
+
+constexpr uint32_t zigzag(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+constexpr int32_t unzigzag(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+
+inline size_t putVarint(uint8_t *out, uint32_t value) {
+  size_t n = 0;
+  for (; value >= 0x80; value >>= 7) out[n++] = uint8_t(value) | 0x80;
+  out[n++] = uint8_t(value);
+  return n;
+}
+
+inline size_t getVarint(const uint8_t *in, size_t size, uint32_t &value) {
+  value = 0;
+  for (size_t n = 0; n < size && n < maxVarintSize; n++) {
+    value |= uint32_t(in[n] & 0x7f) << (7 * n);
+    if (!(in[n] & 0x80)) return n + 1;
+  }
+  return 0;
+}
+
+inline uint16_t crc16(const uint8_t *data, size_t size, uint16_t crc = 0xffff) {
+  for (size_t i = 0; i < size; i++) {
+    crc ^= uint16_t(data[i]) << 8;
+    for (int bit = 0; bit < 8; bit++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// COBS output is at most size + size / 254 + 1 bytes, plus the 0 delimiter that is not written here
+constexpr size_t cobsMaxSize(size_t size) { return size + size / 254 + 1; }
+
+inline size_t cobsEncode(const uint8_t *in, size_t size, uint8_t *out) {
+  size_t code = 0, n = 1;
+  out[0] = 1;
+  for (size_t i = 0; i < size; i++) {
+    if (in[i]) {
+      out[n++] = in[i];
+      if (++out[code] != 0xff) continue;
+      // full block, start a new one unless this was the last byte
+      if (i + 1 == size) break;
+    }
+    code = n++;
+    out[code] = 1;
+  }
+  return n;
+}
+
+inline size_t cobsDecode(const uint8_t *in, size_t size, uint8_t *out) {
+  size_t n = 0;
+  for (size_t i = 0; i < size;) {
+    uint8_t code = in[i++];
+    if (!code || i + code - 1 > size) return 0;
+    for (uint8_t j = 1; j < code; j++) {
+      if (!in[i]) return 0;
+      out[n++] = in[i++];
+    }
+    if (code != 0xff && i < size) out[n++] = 0;
+  }
+  return n;
+}
+
+} // namespace util
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <Arduino.h>
+#include <FspTimer.h>
+
+namespace blastic {
+
+namespace scale {
+
+namespace hx711 {
+
+/*
+  Direct port register access for the HX711 bit banging on the RA4M1, to keep the critical section as short as the
+  protocol allows.
+
+  Pins are either known at compile time (FixedPin, the register address and mask are constants), or resolved once per
+  read from the Arduino pin configuration table (RuntimePin). Both set and clear SCK through PCNTR3 (POSR/PORR) and
+  read DT from PCNTR2 (PIDR), so there is no read-modify-write and no table lookup inside the bit loop.
+*/
+
+inline R_PORT0_Type *portRegisters(uint8_t port) {
+  return reinterpret_cast<R_PORT0_Type *>(R_PORT0_BASE + (R_PORT1_BASE - R_PORT0_BASE) * port);
+}
+
+template <uint16_t portPin> struct FixedPin {
+  static constexpr const uint8_t port = portPin >> 8;
+  static constexpr const uint32_t mask = uint32_t(1) << (portPin & 0xff);
+  [[gnu::always_inline]] void high() const { portRegisters(port)->PCNTR3 = mask; }
+  [[gnu::always_inline]] void low() const { portRegisters(port)->PCNTR3 = mask << 16; }
+  [[gnu::always_inline]] bool read() const { return portRegisters(port)->PCNTR2 & mask; }
+};
+
+struct RuntimePin {
+  R_PORT0_Type *registers = nullptr;
+  uint32_t mask = 0;
+  RuntimePin() = default;
+  explicit RuntimePin(uint8_t pin)
+      : registers(portRegisters(g_pin_cfg[pin].pin >> 8)), mask(uint32_t(1) << (g_pin_cfg[pin].pin & 0xff)) {}
+  [[gnu::always_inline]] void high() const { registers->PCNTR3 = mask; }
+  [[gnu::always_inline]] void low() const { registers->PCNTR3 = mask << 16; }
+  [[gnu::always_inline]] bool read() const { return registers->PCNTR2 & mask; }
+};
+
+// whether pin is in the Arduino pin configuration table and maps to one of the RA4M1 ports P0-P9
+inline bool validPin(unsigned long pin) {
+  if (pin >= g_pin_cfg_size / sizeof(g_pin_cfg[0])) return false;
+  auto portPin = g_pin_cfg[pin].pin;
+  return (portPin >> 8) <= 9 && (portPin & 0xff) < 16;
+}
+
+/*
+  Port/pin of the UNO R4 WiFi digital pins D0-D13, in bsp_io_port_pin_t format. Used to specialize FixedPin on
+  Arduino pin numbers: the mapping is checked at runtime against g_pin_cfg before using a FixedPin.
+*/
+constexpr const uint16_t boardPins[] = {0x0301, 0x0302, 0x0104, 0x0105, 0x0106, 0x0107, 0x010b,
+                                        0x010c, 0x0304, 0x0303, 0x0103, 0x040b, 0x040a, 0x0102};
+
+template <uint8_t pin> using BoardPin = FixedPin<boardPins[pin]>;
+
+inline bool boardPinMatches(uint8_t pin) { return pin < std::size(boardPins) && g_pin_cfg[pin].pin == boardPins[pin]; }
+
+/*
+  HX711 datasheet T3 and T4 (SCK high and low time) are at least 0.2us. Round up to CPU cycles, the port register
+  accesses through the peripheral bus add some more cycles on top of these.
+*/
+constexpr const size_t edgeCycles = (F_CPU / 1000000 * 2 + 9) / 10;
+
+template <size_t... i> [[gnu::always_inline]] inline void nops(std::index_sequence<i...>) { ((void(i), __NOP()), ...); }
+template <size_t cycles> [[gnu::always_inline]] inline void delayCycles() { nops(std::make_index_sequence<cycles>()); }
+
+template <size_t i, typename Sck, typename Dt>
+[[gnu::always_inline]] inline void clockBit(const Sck &sck, const Dt &dt, uint32_t &value) {
+  sck.high();
+  delayCycles<edgeCycles>();
+  if constexpr (i < 24) value = value << 1 | dt.read();
+  sck.low();
+  delayCycles<edgeCycles>();
+}
+
+template <typename Sck, typename Dt, size_t... i>
+[[gnu::always_inline]] inline uint32_t clockBits(const Sck &sck, const Dt &dt, std::index_sequence<i...>) {
+  uint32_t value = 0;
+  (clockBit<i>(sck, dt, value), ...);
+  return value;
+}
+
+/*
+  Clock out the 24 data bits plus the mode selection pulses. The compile time version is fully unrolled.
+*/
+
+template <uint8_t pulses, typename Sck, typename Dt> inline uint32_t clockBits(const Sck &sck, const Dt &dt) {
+  return clockBits(sck, dt, std::make_index_sequence<pulses>());
+}
+
+inline uint32_t clockBits(const RuntimePin &sck, const RuntimePin &dt, uint8_t pulses) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < pulses; i++) {
+    sck.high();
+    delayCycles<edgeCycles>();
+    if (i < 24) value = value << 1 | dt.read();
+    sck.low();
+    delayCycles<edgeCycles>();
+  }
+  return value;
+}
+
+/*
+  Lockstep readout of multiple controllers sharing SCK: at each pulse all the DT pins are sampled, one after the
+  other, while SCK is high. The extra reads only lengthen the high phase by a few cycles per channel.
+*/
+inline void clockBits(const RuntimePin &sck, const RuntimePin *dts, uint8_t channels, uint8_t pulses,
+                      uint32_t *values) {
+  std::fill(values, values + channels, 0);
+  for (uint8_t i = 0; i < pulses; i++) {
+    sck.high();
+    delayCycles<edgeCycles>();
+    if (i < 24)
+      for (uint8_t c = 0; c < channels; c++) values[c] = values[c] << 1 | dts[c].read();
+    sck.low();
+    delayCycles<edgeCycles>();
+  }
+}
+
+/*
+  Timer clocked readout: the SCK pulses are generated by a periodic timer interrupt, that also samples the DT pins of
+  all the channels, while the calling task sleeps until the frame is complete. There is no critical section at all, at
+  the cost of a slower frame (each pulse takes two timer periods) and some interrupt overhead. timerAvailable() opens
+  the timer on first use, and must be true before calling timerClockBits(), which returns false if the frame did not
+  complete.
+*/
+bool timerAvailable();
+bool timerClockBits(uint8_t sck, const uint8_t *dts, uint8_t channels, uint8_t pulses, uint32_t *values);
+
+struct TimerStats {
+  uint32_t frames, failures, lastCycles;
+};
+TimerStats timerStats();
+
+} // namespace hx711
+
+} // namespace scale
+
+} // namespace blastic
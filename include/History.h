@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <Arduino_FreeRTOS.h>
+#include "AnnotatedFloat.h"
+
+namespace blastic {
+
+namespace history {
+
+/*
+  Weight history in a fixed amount of RAM, as aggregates over interval seconds (min, max and mean of the readings,
+  quantized to resolution). A record takes 5 to 8 bytes, so the default 4KB hold about two hours of a busy scale.
+
+  Consecutive intervals with the same aggregate are merged in a single record with a run length, so a scale that sits
+  idle costs a few bytes per change rather than per interval. Records are delta encoded against the previous one with
+  zigzag varints, in blocks of blockSize bytes: the first record of each block is absolute, so that the oldest block
+  can be dropped when the ring is full. append() only updates the running aggregate, plus a short encoding when an
+  interval ends: no allocations, O(1) per reading.
+*/
+
+constexpr const size_t blockSize = 256, blocks = 16;
+constexpr const uint32_t interval = 10;
+constexpr const float resolution = 0.001;
+
+struct Record {
+  // seconds since boot at the start, and number of seconds with this aggregate (a multiple of interval)
+  uint32_t second, seconds;
+  float min, max, mean;
+};
+
+// feed every weight reading, NaN readings (errors) are skipped
+void append(util::AnnotatedFloat weight, TickType_t tick);
+
+/*
+  Read the records oldest first. Each next() call takes the history mutex for a single record, so a slow reader
+  (e.g. printing on Serial) does not block append(). If the reader falls behind and its block is dropped, it skips to
+  the oldest available block. The last record is the one still being extended.
+*/
+struct Cursor {
+  uint32_t block = 0, offset = 0;
+  // the records are decoded relative to the previous one in the block
+  uint32_t second = 0;
+  int32_t min = 0;
+  bool done = false;
+};
+bool next(Cursor &cursor, Record &record);
+
+struct Stats {
+  uint32_t seconds;
+  float min, max, mean;
+};
+// aggregate of the records overlapping the last lastSeconds seconds
+Stats stats(uint32_t lastSeconds);
+
+// bytes used by the encoded records
+size_t bytesUsed();
+
+} // namespace history
+
+} // namespace blastic
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace util {
+
+namespace http {
+
+/*
+  Minimal HTTP/1.1 client building blocks without heap allocations: a writer that formats into a fixed buffer (with
+  inline percent-encoding for x-www-form-urlencoded values), and a response parser that is fed the bytes as they come
+  from the socket, in chunks of any size. There are no dependencies on the Arduino core, so the parser can be exercised
+  on the host.
+*/
+
+class Writer {
+  char *buffer;
+  size_t capacity, size = 0;
+  bool overflow = false;
+
+public:
+  template <size_t N> explicit Writer(char (&buffer)[N]) : buffer(buffer), capacity(N) {}
+
+  // false if anything did not fit in the buffer, the content is then truncated
+  bool ok() const { return !overflow; }
+  const char *data() const { return buffer; }
+  size_t length() const { return size; }
+  void clear() { size = 0, overflow = false; }
+
+  Writer &raw(const char *s, size_t len) {
+    if (size + len > capacity) len = capacity - size, overflow = true;
+    memcpy(buffer + size, s, len);
+    size += len;
+    return *this;
+  }
+  Writer &raw(const char *s) { return raw(s, strlen(s)); }
+  Writer &raw(char c) { return raw(&c, 1); }
+
+  Writer &number(uint32_t n) {
+    char digits[10];
+    size_t len = 0;
+    do digits[sizeof(digits) - ++len] = '0' + n % 10;
+    while (n /= 10);
+    return raw(digits + sizeof(digits) - len, len);
+  }
+
+  // fixed point with the given number of decimals, as Arduino String(float)
+  Writer &decimal(float f, uint8_t decimals = 2) {
+    if (f != f) return raw("nan");
+    if (f < 0) raw('-'), f = -f;
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    auto scaled = uint64_t(double(f) * scale + 0.5);
+    number(uint32_t(scaled / scale));
+    if (!decimals) return *this;
+    raw('.');
+    auto fraction = uint32_t(scaled % scale);
+    for (scale /= 10; scale > fraction && scale > 1; scale /= 10) raw('0');
+    return number(fraction);
+  }
+
+  // percent-encode all but the unreserved characters, as ArduinoHttpClient URLEncoder
+  Writer &urlEncoded(const char *s) {
+    constexpr const char hex[] = "0123456789ABCDEF";
+    for (; *s; s++) {
+      char c = *s;
+      if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_' ||
+          c == '.' || c == '~')
+        raw(c);
+      else {
+        char encoded[] = {'%', hex[uint8_t(c) >> 4], hex[uint8_t(c) & 0xf]};
+        raw(encoded, sizeof(encoded));
+      }
+    }
+    return *this;
+  }
+
+  // quoted and escaped JSON string
+  Writer &jsonString(const char *s) {
+    constexpr const char hex[] = "0123456789abcdef";
+    raw('"');
+    for (; *s; s++) {
+      char c = *s;
+      if (c == '"' || c == '\\') raw('\\').raw(c);
+      else if (uint8_t(c) < 0x20) {
+        char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+        raw(escaped, sizeof(escaped));
+      } else raw(c);
+    }
+    return raw('"');
+  }
+};
+
+/*
+  Response parser. Status line and header lines longer than maxLine are truncated (only Content-Length,
+  Transfer-Encoding and Connection are interpreted anyway). The body is delimited by Content-Length, by the chunked
+  encoding, or by the connection close; in the last case done() is never true and closeDelimited() is set.
+*/
+class ResponseParser {
+public:
+  static constexpr const size_t maxLine = 96;
+
+private:
+  enum class State : uint8_t { STATUS, HEADER, BODY, UNTIL_CLOSE, CHUNK, CHUNK_DATA, CHUNK_END, TRAILER, DONE, ERROR };
+
+  State state = State::STATUS;
+  char line[maxLine];
+  size_t lineLength = 0;
+  uint32_t remaining = 0;
+  int statusCode = 0;
+  int32_t length = -1;
+  bool chunked = false, close = false;
+
+  static bool equalsIgnoreCase(const char *a, const char *b) {
+    for (; *a && *b; a++, b++)
+      if ((*a | 0x20) != (*b | 0x20)) return false;
+    return *a == *b;
+  }
+
+  template <typename OnHeader> void parseLine(OnHeader &onHeader) {
+    switch (state) {
+    case State::STATUS: {
+      // HTTP/1.x NNN reason
+      if (lineLength < 12 || strncmp(line, "HTTP/1.", 7) || line[8] != ' ') {
+        state = State::ERROR;
+        return;
+      }
+      statusCode = 0;
+      for (size_t i = 9; i < 12; i++) {
+        if (line[i] < '0' || line[i] > '9') {
+          state = State::ERROR;
+          return;
+        }
+        statusCode = statusCode * 10 + line[i] - '0';
+      }
+      // HTTP/1.0 closes by default
+      close = line[7] == '0';
+      state = State::HEADER;
+      return;
+    }
+    case State::HEADER: {
+      if (!lineLength) {
+        // informational responses are followed by the real one
+        if (statusCode < 200) state = State::STATUS, length = -1, chunked = false;
+        else if (statusCode == 204 || statusCode == 304 || length == 0) state = State::DONE;
+        else if (chunked) state = State::CHUNK;
+        else if (length > 0) state = State::BODY, remaining = length;
+        else state = State::UNTIL_CLOSE, close = true;
+        return;
+      }
+      auto colon = strchr(line, ':');
+      if (!colon) return;
+      *colon = 0;
+      auto value = colon + 1;
+      while (*value == ' ' || *value == '\t') value++;
+      if (equalsIgnoreCase(line, "Content-Length")) {
+        char *end;
+        auto n = strtoul(value, &end, 10);
+        if (end == value) state = State::ERROR;
+        else length = int32_t(n);
+      } else if (equalsIgnoreCase(line, "Transfer-Encoding")) chunked = equalsIgnoreCase(value, "chunked");
+      else if (equalsIgnoreCase(line, "Connection")) close = equalsIgnoreCase(value, "close");
+      onHeader(line, value);
+      return;
+    }
+    case State::CHUNK: {
+      // chunk size line
+      char *end;
+      remaining = strtoul(line, &end, 16);
+      if (end == line) state = State::ERROR;
+      else state = remaining ? State::CHUNK_DATA : State::TRAILER;
+      return;
+    }
+    case State::CHUNK_END: state = lineLength ? State::ERROR : State::CHUNK; return;
+    case State::TRAILER:
+      if (!lineLength) state = State::DONE;
+      return;
+    default: return;
+    }
+  }
+
+public:
+  bool done() const { return state == State::DONE; }
+  bool error() const { return state == State::ERROR; }
+  bool closeDelimited() const { return state == State::UNTIL_CLOSE; }
+  int status() const { return statusCode; }
+  // the server wants the connection closed, or the body ends with the connection
+  bool mustClose() const { return close; }
+
+  /*
+    Parse size bytes, calling onHeader(name, value) for each header and onBody(data, size) for each piece of the
+    (dechunked) body. Returns the bytes consumed, less than size only when done() or error().
+  */
+  template <typename OnHeader, typename OnBody>
+  size_t feed(const uint8_t *in, size_t size, OnHeader &&onHeader, OnBody &&onBody) {
+    size_t i = 0;
+    while (i < size && state != State::DONE && state != State::ERROR) {
+      if (state == State::UNTIL_CLOSE || state == State::BODY || state == State::CHUNK_DATA) {
+        size_t n = size - i;
+        if (state != State::UNTIL_CLOSE && n > remaining) n = remaining;
+        onBody(in + i, n);
+        i += n;
+        if (state == State::UNTIL_CLOSE || (remaining -= n)) continue;
+        state = state == State::BODY ? State::DONE : State::CHUNK_END;
+        continue;
+      }
+      char c = in[i++];
+      if (c != '\n') {
+        if (lineLength < maxLine - 1) line[lineLength++] = c;
+        continue;
+      }
+      if (lineLength && line[lineLength - 1] == '\r') lineLength--;
+      line[lineLength] = 0;
+      parseLine(onHeader);
+      lineLength = 0;
+    }
+    return i;
+  }
+};
+
+} // namespace http
+
+} // namespace util
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace blastic {
+
+namespace journal {
+
+/*
+  Persistent queue of the submissions waiting for upload, in the RA4M1 data flash (8 blocks of 1KB). Records of 16
+  bytes are appended in a ring of blocks and never rewritten: a delivery is recorded by appending an ack record, and a
+  block is erased only when the ring wraps around to it and all its submissions have been acked, so the blocks wear
+  evenly. Each record has a CRC, and a write torn by a power loss is skipped when the journal is scanned at boot.
+
+  Each endpoint (see Submitter::EEPROMConfig::endpoints) has its own ack cursor, so that the submissions are delivered
+  to all the active endpoints independently. The ack records carry the endpoint index.
+
+  The journal owns the data flash, do not use the Arduino EEPROM library together with it.
+*/
+
+constexpr const uint8_t maxEndpoints = 3;
+
+struct Submission {
+  // write order of the records, acks refer to it
+  uint32_t serial;
+  uint8_t plastic;
+  float weight;
+  // seconds since boot at creation, meaningful only if the submission was created since this boot
+  uint32_t seconds;
+  bool thisBoot;
+};
+
+// open the data flash and scan the records, call once at boot before anything else (false if it cannot be opened)
+bool begin();
+
+// returns the serial of the submission, 0 if the journal is full (too many submissions not acked) or the write failed
+uint32_t append(uint8_t plastic, float weight);
+
+/*
+  Set the endpoints that submissions are delivered to, as a bit mask. Until the first call all endpoints are considered
+  active, afterwards an endpoint that becomes active starts from the next submission. Inactive endpoints do not hold
+  back the reuse of the flash blocks.
+*/
+void endpoints(uint8_t mask);
+
+// copy up to max of the oldest submissions not acked by endpoint, oldest first, and return how many
+size_t front(uint8_t endpoint, Submission *submissions, size_t max);
+
+// mark the submissions up to serial as done (uploaded or dropped) for endpoint
+bool ack(uint8_t endpoint, uint32_t serial);
+
+struct Stats {
+  // submissions not acked by some active endpoint
+  size_t pending, freeSlots;
+  uint32_t writeErrors;
+};
+Stats stats();
+
+// submissions not acked by endpoint
+size_t pending(uint8_t endpoint);
+
+} // namespace journal
+
+} // namespace blastic
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <Arduino_FreeRTOS.h>
+
+namespace blastic {
+
+namespace scale {
+
+/*
+  Sliding window median / trimmed mean filter with a fixed capacity N, and a window width that can be chosen at
+  runtime (up to N).
+
+  The filter keeps two static arrays: the samples in insertion order (a ring), and the same samples sorted. A new
+  sample evicts the oldest one once the window is full: both the eviction and the insertion in the sorted array use a
+  binary search, so each update takes O(log n) comparisons plus a memmove of at most n elements. There is no heap or
+  VLA usage, so the stack footprint is known at compile time.
+*/
+
+template <typename T, size_t N> class MedianFilter {
+  static_assert(N > 0);
+  using Sum = std::conditional_t<std::is_integral_v<T>, int64_t, T>;
+
+  T window[N], sorted[N];
+  size_t width, size = 0, next = 0;
+
+public:
+  explicit MedianFilter(size_t width = N) { reset(width); }
+
+  void reset(size_t width = N) {
+    configASSERT(width && width <= N);
+    this->width = width, size = next = 0;
+  }
+
+  void push(T value) {
+    if (size == width) {
+      // remove the oldest sample from the sorted array
+      auto evicted = std::lower_bound(sorted, sorted + size, window[next]);
+      std::move(evicted + 1, sorted + size, evicted);
+      size--;
+    }
+    window[next] = value;
+    next = next + 1 == width ? 0 : next + 1;
+    auto inserted = std::upper_bound(sorted, sorted + size, value);
+    std::move_backward(inserted, sorted + size, sorted + size + 1);
+    *inserted = value;
+    size++;
+  }
+
+  size_t count() const { return size; }
+  bool full() const { return size == width; }
+
+  // i-th sample in insertion order, 0 is the oldest
+  const T &operator[](size_t i) const { return window[(next + width - size + i) % width]; }
+
+  // must not be called on an empty filter, even windows return the average of the two central samples
+  T median() const {
+    configASSERT(size);
+    if (size % 2) return sorted[size / 2];
+    return (sorted[size / 2 - 1] + sorted[size / 2]) / 2;
+  }
+
+  // mean of the samples, excluding the trim lowest and trim highest ones
+  T trimmedMean(size_t trim) const {
+    configASSERT(2 * trim < size);
+    Sum sum = 0;
+    for (auto s = sorted + trim; s < sorted + size - trim; s++) sum += *s;
+    return T(sum / Sum(size - 2 * trim));
+  }
+};
+
+} // namespace scale
+
+} // namespace blastic
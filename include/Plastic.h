@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+namespace blastic {
+
+enum class plastic : uint8_t { PET = 1, HDPE = 2, PVC = 3, LDPE = 4, PP = 5, PS = 6, other = 7 };
+
+constexpr const plastic plastics[]{plastic::PET, plastic::HDPE, plastic::PVC,  plastic::LDPE,
+                                   plastic::PP,  plastic::PS,   plastic::other};
+
+constexpr const char *plasticName(plastic p) {
+  switch (p) {
+  case plastic::PET: return "Pet";
+  case plastic::HDPE: return "HDPE";
+  case plastic::PVC: return "PVC";
+  case plastic::LDPE: return "LDPE";
+  case plastic::PP: return "PP";
+  case plastic::PS: return "PS";
+  default: return "Other";
+  }
+}
+
+} // namespace blastic
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace util {
+
+/*
+  Fixed size, lock-free ring buffer for a single producer. The producer never blocks and always overwrites the oldest
+  entry. Entries are addressed by their absolute index (the number of entries pushed before them), so that readers can
+  keep their own position and detect when they have been lapped by the producer.
+
+  The producer can run in a task or in an interrupt context. Readers copy entries out with read(), which fails if the
+  entry has been overwritten (or is being overwritten) while copying. This is a seqlock where the head index doubles
+  as the sequence number of every slot: any number of readers, each with its own cursor, never block the producer or
+  each other, and a torn copy is always detected and discarded.
+*/
+
+template <typename T, size_t N> class RingLog {
+  static_assert(N && !(N & (N - 1)), "RingLog size must be a power of two");
+
+  T entries[N];
+  std::atomic<uint32_t> head{0};
+
+public:
+  void push(const T &t) {
+    auto h = head.load(std::memory_order_relaxed);
+    // the previous head store must be visible before any write to the slot, pairs with the fence in read()
+    std::atomic_thread_fence(std::memory_order_release);
+    entries[h % N] = t;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  // number of entries pushed so far, which is also the index of the next entry
+  uint32_t count() const { return head.load(std::memory_order_acquire); }
+
+  // oldest index that can still be read
+  uint32_t tail() const {
+    auto h = count();
+    return h > N - 1 ? h - (N - 1) : 0;
+  }
+
+  bool read(uint32_t i, T &t) const {
+    // only entries in [count() - N + 1, count()) are guaranteed not to be overwritten while copying
+    if (count() - i - 1 >= N - 1) return false;
+    t = entries[i % N];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // the slot of entry i is rewritten when the producer pushes entry i + N
+    return count() - i < N;
+  }
+};
+
+} // namespace util
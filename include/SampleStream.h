@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Framing.h"
+
+namespace blastic {
+
+namespace scale {
+
+namespace stream {
+
+/*
+  Binary raw sample stream format (scale::stream on). Each frame is COBS encoded and enclosed in 0 bytes, so frames
+  can be told apart from CLI text printed in between. Decoded, a frame is:
+
+    uint8_t  recordType     samplesRecord
+    uint8_t  mode           HX711Mode of all the samples in the frame
+    varint   index          acquisition index of the first sample, gaps mean lost samples
+    varint   millis         timestamp of the first sample
+    varint   zigzag(raw)    first combined raw read
+    then for each further sample:
+    varint   deltaMillis    from the previous sample
+    varint   zigzag(delta)  raw read minus the previous one
+    uint16_t crc            CRC-16/CCITT of all the bytes above, big endian
+
+  The samples in a frame are consecutive (no gaps in index). This header does not depend on the Arduino core, so that
+  the host decoder in scripts/stream-decoder.cpp can use it.
+*/
+
+constexpr const uint8_t samplesRecord = 1;
+constexpr const size_t maxFrameSamples = 16;
+constexpr const size_t maxFrameSize = 2 + 3 * util::maxVarintSize + (maxFrameSamples - 1) * 2 * util::maxVarintSize + 2;
+constexpr const size_t maxEncodedFrameSize = util::cobsMaxSize(maxFrameSize) + 2;
+
+} // namespace stream
+
+} // namespace scale
+
+} // namespace blastic
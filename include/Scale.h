@@ -5,6 +5,9 @@
 #include <Arduino_FreeRTOS.h>
 #include "AnnotatedFloat.h"
 #include "murmur32.h"
+#include "StabilityDetector.h"
+#include "SettlingPredictor.h"
+#include "Checkweigher.h"
 
 namespace blastic {
 
@@ -13,14 +16,54 @@ namespace scale {
 // HX711Mode can be cast to an integer and used as index in arrays below
 enum class HX711Mode : uint8_t { A128 = 0, B = 1, A64 = 2 };
 
+constexpr const size_t maxCalibrationPoints = 8;
+// the HX711 driver is specialized at compile time for these pins
+constexpr const uint8_t defaultDataPin = 5, defaultClockPin = 4;
+// HX711 controllers that can share the clock pin, e.g. one per load cell on a multi-cell platform
+constexpr const size_t maxChannels = 4;
+
 struct [[gnu::packed]] EEPROMConfig {
-  uint8_t dataPin, clockPin;
+  uint8_t clockPin;
+  // number of HX711 controllers on clockPin, all clocked out together, at least 1
+  uint8_t channels;
+  struct [[gnu::packed]] channel {
+    uint8_t dataPin;
+    // the combined raw read is the sum of the channel raw reads, each multiplied by its trim (corner adjustment)
+    float trim;
+  } dataChannels[maxChannels];
   HX711Mode mode;
+  // keep the HX711 powered and sample it from a dedicated task, see continuous() below
+  bool continuous;
+  // generate the SCK pulses from a timer interrupt instead of bit banging in a critical section
+  bool timerReadout;
+  // switch between A128 and A64 according to the load, see autoRanging() below
+  bool autoRange;
   struct [[gnu::packed]] calibration {
-    int32_t tareRawRead, weightRawRead;
-    float weight;
-    operator bool() const { return this->weightRawRead != this->tareRawRead; }
+    int32_t tareRawRead;
+    // calibration points in any order, the tare is an implicit point with weight 0
+    uint8_t points;
+    struct [[gnu::packed]] point {
+      int32_t rawRead;
+      float weight;
+    } weights[maxCalibrationPoints];
+    // raw read of each channel at tare, used to split the weight between channels
+    int32_t channelTareRawReads[maxChannels];
+    operator bool() const { return this->points; }
   } calibrations[3];
+  StabilityDetector::EEPROMConfig stability;
+  SettlingPredictor::EEPROMConfig prediction;
+  // automatic zero tracking, all values in weight units, band == 0 disables it
+  struct [[gnu::packed]] {
+    float band, maxRate, maxStep;
+  } zeroTracking;
+  // adaptive acquisitions (see adaptiveMedian), resolution is the target standard error in weight units
+  struct [[gnu::packed]] {
+    float resolution;
+    uint8_t minSamples, maxSamples;
+  } adaptive;
+  // in-motion weighing of a stream of items, see checkweigher() below
+  bool checkweigher;
+  Checkweigher::EEPROMConfig checkweighing;
   auto &getCalibration() { return calibrations[uint8_t(mode)]; }
   auto &getCalibration() const { return calibrations[uint8_t(mode)]; }
 };
@@ -31,23 +74,204 @@ static constexpr const std::tuple<uint32_t, HX711Mode> modeHashes[]{makeModeHash
 #define makeModeString(m) #m
 static constexpr const char *modeStrings[]{makeModeString(A128), makeModeString(B), makeModeString(A64)};
 
-constexpr const int32_t readErr = 0x800000;
-const util::AnnotatedFloat weightCal = util::AnnotatedFloat("cal"), weightErr = util::AnnotatedFloat("err");
+// range of the combined raw reads, with the trims at most 1 (all channels at full scale)
+constexpr const int32_t rawMin = -int32_t(maxChannels) * 0x800000, rawMax = -rawMin - 1;
+constexpr const int32_t readErr = INT32_MIN;
+const util::AnnotatedFloat weightCal = util::AnnotatedFloat("cal"), weightErr = util::AnnotatedFloat("err"),
+                           weightSat = util::AnnotatedFloat("sat");
 constexpr const uint32_t minReadDelayMillis = 1000 / 80; // max output rate is 80Hz
+constexpr const size_t maxMedianWidth = 32;
+// pass as medianWidth to stop the acquisition as soon as the result is within config.adaptive.resolution
+constexpr const size_t adaptiveMedian = 0;
+
+/*
+  Piecewise linear conversion from raw reads to weight, compiled from a calibration.
+
+  The tare and the calibration points are sorted by raw read, and each segment between two of them is stored as a
+  fixed point base weight and slope. The first and last segments are extended to cover the whole raw read range. The
+  fixed point format is chosen at compile time so that the largest weight in that range fits in an int32_t, and each
+  segment slope has its own shift. The conversion is a binary search on the segments, a 32x32->64 bit multiplication
+  and a shift: the result is then multiplied by unit() to get the weight.
+*/
+
+class Transform {
+public:
+  // returns false if the calibration is empty, or two points have the same raw read
+  bool compile(const EEPROMConfig::calibration &calibration);
+  operator bool() const { return segments; }
+  int32_t operator()(int32_t raw) const;
+  float unit() const { return fixedPointUnit; }
+
+private:
+  struct Segment {
+    int32_t rawStart, base, slope;
+    uint8_t shift;
+  } table[maxCalibrationPoints];
+  uint8_t segments = 0;
+  float fixedPointUnit = 0;
+};
+
+struct Sample {
+  // combined raw read of all the channels
+  int32_t value;
+  TickType_t tick;
+  // mode of the conversion, with auto ranging it changes from sample to sample
+  HX711Mode mode;
+  uint8_t channels;
+  int32_t channelValues[maxChannels];
+};
+
+/*
+  Length of the critical sections in the HX711 read, in CPU cycles, separately for the compile time specialized
+  driver of the default pins and for the runtime pins driver.
+*/
+struct CriticalSectionStats {
+  uint32_t last, max, count;
+};
+CriticalSectionStats criticalSectionStats(bool fixedPins);
 
 /*
-  Read a raw value from HX711. Can run multiple measurements and get the median.
+  Start or stop the continuous acquisition task according to config.continuous.
 
-  This function switches on and back off the controller. The execution is
-  also protected by a global mutex.
+  While running, the task owns the HX711: it keeps the controller powered, sleeps until the data pin falling edge
+  (or polls it, if the pin has no interrupt), and pushes each conversion in a ring buffer. With multiple channels, the
+  task waits until all the data pins are low, then clocks out all the controllers in lockstep on the shared clock pin.
+  Pins and mode are read again from config at every conversion, so config must outlive the task (normally it is
+  blastic::config.scale).
+*/
+void continuous(const EEPROMConfig &config);
+
+/*
+  Keep the continuous acquisition running on config while the object is alive, even if config.continuous is off.
+  Readers that sample repeatedly (e.g. the weight preview) should hold one, so that they and any concurrent raw() or
+  weight() call read from the ring buffer instead of serializing on the one-shot mutex, each waiting for a power cycle.
+*/
+class Subscription {
+  const EEPROMConfig &config;
+
+public:
+  explicit Subscription(const EEPROMConfig &config);
+  ~Subscription();
+  Subscription(const Subscription &) = delete;
+  Subscription &operator=(const Subscription &) = delete;
+};
+
+/*
+  Sample by sample access to the continuous acquisition. Start from sampleCursor() (the next sample to be pushed, or
+  with latest the last one pushed, if any), then each nextSample() call returns the sample at cursor and advances it,
+  waiting up to timeout for a new sample. If the reader is too slow and the sample has been overwritten, the cursor
+  skips to the oldest sample available. Readers never block the acquisition task or each other. Returns false on
+  timeout, or if the continuous acquisition is not running on config.
+*/
+uint32_t sampleCursor(bool latest = false);
+bool nextSample(const EEPROMConfig &config, uint32_t &cursor, Sample &sample, TickType_t timeout = portMAX_DELAY);
+
+/*
+  Read a raw value from HX711. Can run multiple measurements (up to maxMedianWidth) and get the median.
+
+  With medianWidth == adaptiveMedian the number of measurements depends on the noise: the acquisition stops when the
+  standard error of the median, estimated with a running variance, is below config.adaptive.resolution, after at
+  least config.adaptive.minSamples and at most config.adaptive.maxSamples measurements. On timeout, the median of the
+  measurements taken so far is returned if there are at least config.adaptive.minSamples of them. Without a
+  calibration the resolution cannot be converted to raw counts, and maxSamples measurements are always taken.
+
+  In one-shot mode, this function switches on and back off the controller, and the execution is protected by a global
+  mutex. If the continuous acquisition task is running on the same config, the median is instead calculated on the
+  next medianWidth samples in the ring buffer. Concurrent one-shot calls with the same config and medianWidth are
+  coalesced: the later callers wait for the read in flight and return its result, instead of queuing for their own.
+  If that read fails, e.g. on a shorter timeout, they read again on their own with the time they have left.
 */
 int32_t raw(const EEPROMConfig &config, size_t medianWidth = 1, TickType_t timeout = portMAX_DELAY);
 
 /*
-  As above, but return a computed weight using calibration data.
+  As raw(), but also return the median of each channel, taken from the same conversions. Unused channels are set to
+  0. Returns false where raw() would return readErr.
+*/
+bool rawChannels(const EEPROMConfig &config, int32_t &combined, int32_t (&channels)[maxChannels],
+                 size_t medianWidth = 1, TickType_t timeout = portMAX_DELAY);
+
+/*
+  Split a weight between the channels (corner load view), proportionally to the trimmed raw read of each channel
+  above its tare.
+*/
+void channelWeights(const EEPROMConfig &config, const int32_t (&channels)[maxChannels], float weight,
+                    float (&weights)[maxChannels]);
+
+/*
+  Standard deviation of the raw reads in the last acquisition with at least two samples, NAN if none yet.
+*/
+float noise();
+
+/*
+  Auto ranging is active when config.autoRange is set, the mode is on channel A, and both the A128 and A64 modes are
+  calibrated. The readout then switches to A64 when a channel gets close to saturation in A128, and back to A128 when
+  the load is light enough, with hysteresis between the two thresholds.
+
+  Only weight() below follows the range. raw() and rawChannels() always use config.mode, so calibrate each mode with
+  auto ranging disabled.
+*/
+bool autoRanging(const EEPROMConfig &config);
+
+/*
+  As raw(), but return a computed weight using calibration data. With auto ranging the mode may change while
+  collecting the samples for the median: the median is then restarted in the new mode. Returns weightSat if most
+  samples are saturated.
 */
 util::AnnotatedFloat weight(const EEPROMConfig &config, size_t medianWidth = 1, TickType_t timeout = portMAX_DELAY);
 
+/*
+  Weight from the samples already in the ring buffer with a tick in [from, to], without starting an acquisition: the
+  median of the latest samples in the window (up to maxMedianWidth), in the mode of the latest one. Returns weightErr
+  if fewer than minSamples are available, e.g. because the continuous acquisition was not running in that window.
+*/
+util::AnnotatedFloat bufferedWeight(const EEPROMConfig &config, TickType_t from, TickType_t to, size_t minSamples = 3);
+
+/*
+  Convert a raw read taken in the given mode to weight. The Transform of each mode is cached, and compiled again only
+  after calibrationChanged(): call it whenever config.calibrations is modified. The zero tracking offset (see below)
+  is subtracted from the result.
+*/
+util::AnnotatedFloat weight(const EEPROMConfig &config, int32_t raw, HX711Mode mode);
+void calibrationChanged();
+
+/*
+  Automatic zero tracking. Feed every weight reading taken while idle or previewing: when the reading is below
+  threshold (unloaded) and within zeroTracking.maxStep of the previous one (stable), the zero offset moves towards it
+  by at most zeroTracking.maxRate per second, and never beyond zeroTracking.band. The stored calibration is not
+  modified. Each update is O(1).
+*/
+void trackZero(const EEPROMConfig &config, util::AnnotatedFloat weight, TickType_t tick, float threshold);
+float zeroOffset();
+void resetZero();
+
+/*
+  Checkweigher task: while config.checkweigher is set, segment the continuous acquisition samples into items (see
+  Checkweigher), and keep the latest ones in a log. Every sample is used, so this runs at the full HX711 output rate.
+  The continuous acquisition must be running, and as with continuous() config must outlive the task.
+*/
+void checkweigher(const EEPROMConfig &config);
+
+// number of items logged so far, the log keeps the latest ones only
+uint32_t checkweighedItems();
+// returns false if item i is no longer (or not yet) in the log
+bool checkweighedItem(uint32_t i, Checkweigher::Item &item);
+
+namespace stream {
+
+/*
+  Binary raw sample stream on Serial (format in SampleStream.h): a task encodes the continuous acquisition samples of
+  config in frames of up to 16 samples, and writes each frame with a single Serial write. Samples lost because the
+  task could not keep up with the ring buffer show up as index gaps, and are counted in Stats::lost.
+*/
+struct Stats {
+  uint32_t frames, samples, lost;
+};
+void enable(const EEPROMConfig &config, bool on);
+bool enabled();
+Stats getStats();
+
+} // namespace stream
+
 } // namespace scale
 
 } // namespace blastic
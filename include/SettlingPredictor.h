@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <Arduino_FreeRTOS.h>
+
+namespace blastic {
+
+namespace scale {
+
+/*
+  SettlingPredictor estimates the final weight while the load cell is still ringing or creeping after a load is
+  applied.
+
+  The last window samples are fitted (least squares) to a second order autoregressive model with a constant term:
+
+    y[n] = a1 * y[n-1] + a2 * y[n-2] + c
+
+  which describes exactly both an exponential approach and a damped oscillation towards y = c / (1 - a1 - a2). The
+  uncertainty of the prediction is the standard error of that expression, propagated from the covariance of the fitted
+  parameters. The model assumes evenly spaced samples, so the window is reset on gaps longer than maxGapMillis: in
+  practice, predictions are only available with continuous acquisition.
+*/
+
+class SettlingPredictor {
+public:
+  struct [[gnu::packed]] EEPROMConfig {
+    // samples in the fit window, at most capacity
+    uint8_t window;
+    // show the prediction only when the standard error is below this value, in weight units
+    float maxUncertainty;
+  };
+
+  static constexpr const size_t capacity = 32, minWindow = 8;
+  static constexpr const uint32_t maxGapMillis = 150;
+
+  // returns true if a prediction within maxUncertainty is available
+  bool update(const EEPROMConfig &config, float weight, TickType_t tick);
+  void reset();
+
+  bool confident() const { return isConfident; }
+  float prediction() const { return lastPrediction; }
+  float uncertainty() const { return lastUncertainty; }
+
+protected:
+  float weights[capacity];
+  TickType_t lastTick = 0;
+  size_t size = 0, next = 0;
+  bool isConfident = false;
+  float lastPrediction = 0, lastUncertainty = INFINITY;
+
+  float at(size_t i) const { return weights[(next + capacity - size + i) % capacity]; }
+  bool fit();
+};
+
+} // namespace scale
+
+} // namespace blastic
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <Arduino_FreeRTOS.h>
+
+namespace blastic {
+
+namespace scale {
+
+/*
+  StabilityDetector tracks the standard deviation and the slope (linear regression) of the weight over a time window,
+  and emits a SETTLED event when both are below the configured limits, and an UNSETTLED event when either of them
+  exceeds twice its limit. While settled, value() is the mean weight over the window.
+
+  At most capacity samples are kept: samples closer than windowMillis / capacity to the previous one are skipped, so
+  the window always spans windowMillis regardless of the sample rate.
+*/
+
+class StabilityDetector {
+public:
+  struct [[gnu::packed]] EEPROMConfig {
+    uint16_t windowMillis;
+    // standard deviation in weight units, slope in weight units per second
+    float maxDeviation, maxSlope;
+  };
+
+  enum class Event : uint8_t { NONE, SETTLED, UNSETTLED };
+
+  static constexpr const size_t capacity = 32;
+
+  Event update(const EEPROMConfig &config, float weight, TickType_t tick);
+  void reset();
+
+  bool settled() const { return isSettled; }
+  float value() const { return settledValue; }
+  float deviation() const { return lastDeviation; }
+  float slope() const { return lastSlope; }
+
+protected:
+  float weights[capacity];
+  TickType_t ticks[capacity];
+  size_t size = 0, next = 0;
+  bool isSettled = false;
+  float settledValue = 0, lastDeviation = 0, lastSlope = 0;
+
+  size_t index(size_t i) const { return (next + capacity - size + i) % capacity; }
+};
+
+} // namespace scale
+
+} // namespace blastic
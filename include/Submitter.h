@@ -5,26 +5,12 @@
 #include "StaticTask.h"
 #include "Looper.h"
 #include "utils.h"
+#include "Journal.h"
+#include "Backends.h"
+#include "Plastic.h"
 
 namespace blastic {
 
-enum class plastic : uint8_t { PET = 1, HDPE = 2, PVC = 3, LDPE = 4, PP = 5, PS = 6, other = 7 };
-
-constexpr const plastic plastics[]{plastic::PET, plastic::HDPE, plastic::PVC,  plastic::LDPE,
-                                   plastic::PP,  plastic::PS,   plastic::other};
-
-constexpr const char *plasticName(plastic p) {
-  switch (p) {
-  case plastic::PET: return "Pet";
-  case plastic::HDPE: return "HDPE";
-  case plastic::PVC: return "PVC";
-  case plastic::LDPE: return "LDPE";
-  case plastic::PP: return "PP";
-  case plastic::PS: return "PS";
-  default: return "Other";
-  }
-}
-
 /*
   Wrapper class, to be returned by any function that can time out.
 */
@@ -55,20 +41,30 @@ public:
 
   struct [[gnu::packed]] EEPROMConfig {
     float threshold;
+    // on OK, submit the value from the stability detector if settled, instead of taking a new measurement
+    bool captureSettled;
+    // on OK, submit the median of the samples in the captureWindow milliseconds before the button edge, if any
+    uint16_t captureWindow;
     char collectionPoint[128], collectorName[128];
-    struct FormParameters {
-      char urn[128], type[32], collectionPoint[32], collectorName[32], weight[32];
-    } form;
+    // endpoint configuration, see Backends.h
+    using Backend = uploader::Endpoint::Backend;
+    using Endpoint = uploader::Endpoint;
+    // every submission is delivered to each enabled endpoint
+    Endpoint endpoints[journal::maxEndpoints];
   };
 
   Submitter(const char *name, UBaseType_t priority);
   void action(Action action);
-  void action_ISR(Action action);
+  // edgeTick is the tick of the button edge that triggered the action
+  void action_ISR(Action action, TickType_t edgeTick);
 
 protected:
   util::Looper<1024> painter;
   util::StaticTask<4 * 1024> task;
   int lastInteractionMillis;
+  volatile TickType_t actionTick = 0;
+  scale::StabilityDetector stability;
+  scale::SettlingPredictor predictor;
 
   void gotInput();
   Action idling();
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Journal.h"
+#include "Fanout.h"
+#include "Submitter.h"
+
+namespace blastic {
+
+namespace uploader {
+
+/*
+  Background task that drains the submission journal (see Journal.h), oldest first, so that the UI never waits for
+  WiFi, TLS or the server. Every submission is delivered to each enabled endpoint in config.submit.endpoints, by a
+  Fanout (see Fanout.h) over TLS connections, within a single WiFi session.
+*/
+
+// start the task, it immediately tries to upload the submissions left in the journal
+void start();
+
+// try now, e.g. after the endpoints were changed
+void wake();
+
+// a new submission was appended to the journal, try now and time its delivery
+void submitted(uint32_t serial);
+
+/*
+  Someone is about to weigh: bring up WiFi and open the TLS connections to the endpoints in the background, so that
+  the submission goes out without waiting for association, DHCP and the handshakes. If nothing follows, WiFi and the
+  TLS connections are brought down together after the disconnectTimeout of the WiFi configuration.
+*/
+void prewarm();
+
+// send the submissions held by a batching backend now, e.g. when the scale goes idle
+void flush();
+
+// some endpoint is enabled and configured
+bool configured();
+
+Stats stats(uint8_t endpoint);
+
+} // namespace uploader
+
+} // namespace blastic
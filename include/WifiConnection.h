@@ -20,15 +20,47 @@ class WifiConnection : public util::Mutexed<WiFi> {
 public:
   static const bool ipConnectBroken;
 
+  struct [[gnu::packed]] IPv4Config {
+    uint32_t ip, gateway, subnet, dns;
+  };
+
   struct [[gnu::packed]] EEPROMConfig {
     // leave the password empty to connect to an open network
     char ssid[32], password[64];
     unsigned long dhcpTimeout, disconnectTimeout;
+    // static address that skips DHCP, leave ip zero to use DHCP
+    IPv4Config staticIP;
+  };
+
+  /*
+    The last connection made: the access point, the address obtained (e.g. to pin a DHCP lease as static address), and
+    how long the association and the address configuration took. A constructor that finds the connection already up
+    sets reused and leaves the rest untouched. Access it while holding the WiFi mutex. It is kept in RAM only: to
+    reuse a lease after a reboot, copy it to EEPROMConfig::staticIP.
+  */
+  struct Connection {
+    uint8_t bssid[6];
+    IPv4Config lease;
+    uint32_t associationMillis, addressMillis;
+    bool reused;
   };
 
+  // fails (see operator bool) without even trying if the modem firmware is not the expected one
   WifiConnection(const EEPROMConfig &config);
+  /*
+    The modem runs the firmware version that the WiFiS3 library expects. The modem is asked once, then the answer is
+    cached, so that the check does not wait for the WiFi mutex.
+  */
+  static bool firmwareOk();
   // was the connection successful?
   operator bool() const;
+  static const Connection &lastConnection();
+  /*
+    Set a function to call, with the WiFi mutex held, right before the WiFi connection is brought down (after the
+    disconnect timeout, or to connect again). Use it to close the clients kept open across WifiConnection instances:
+    the modem drops their sockets anyway.
+  */
+  static void onDisconnect(void (*callback)());
   ~WifiConnection();
 };
 
@@ -63,14 +95,43 @@ public:
     some time after receiving no data (read() == 0).
 
     These read() function overrides make sure that a connected() call is made right before
-    (suppressing other FreeRTOS tasks) the actual read, to *minimize* the chances of
-    crashing. I really hope that I'll be able to get the Arduino developers to push a
-    firmware version 0.5.0, fixing this behavior.
+    the actual read, with the WiFi mutex held so that no other task talks to the modem in
+    between, to *minimize* the chances of crashing. I really hope that I'll be able to get
+    the Arduino developers to push a firmware version 0.5.0, fixing this behavior.
+
+    The connected() check is skipped when the previous modem read filled the buffer, which
+    proves the connection alive just as well, so a stream costs one modem transaction per
+    transfer. After a short read the stream may be over, and the check is made again.
+    Reads smaller than the receive buffer are served from it, filled a whole modem transfer
+    at a time. bufferedReads(false) goes back to a check and a transaction per read, to
+    compare the throughput (see tls::ping).
 
   */
+  struct ReadStats {
+    uint32_t modemReads, connectedChecks, bytes;
+    // time spent holding the WiFi mutex in reads
+    uint32_t modemMicros;
+  };
+  static ReadStats readStats();
+  static void bufferedReads(bool on);
+  static bool bufferedReads();
+
+  virtual int available();
+  virtual int peek();
   virtual int read();
   virtual int read(uint8_t *buf, size_t size);
+  virtual uint8_t connected();
+  virtual void stop();
   ~WiFiSSLClient() { stop(); }
+
+private:
+  // the client FIFO holds RX_BUFFER_DIM bytes, and a modem transfer fetches at most one less
+  uint8_t rxBuffer[RX_BUFFER_DIM - 1];
+  uint16_t rxStart = 0, rxEnd = 0;
+  // the last modem read filled the buffer
+  bool alive = false;
+
+  int modemRead(uint8_t *buf, size_t size);
 };
 
 } // namespace blastic
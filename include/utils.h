@@ -7,7 +7,8 @@
 */
 
 template <typename T, typename U, size_t alen> inline T *strcpy0(T (&dst)[alen], const U *src, size_t len = alen) {
+  len = len < alen ? len : alen - 1;
   strncpy(dst, src, len);
-  dst[len < alen ? len : alen - 1] = 0;
+  dst[len] = 0;
   return dst;
 }
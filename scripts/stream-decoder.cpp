@@ -0,0 +1,77 @@
+/*
+  Decode the binary raw sample stream of scale::stream (format in include/SampleStream.h) to CSV.
+
+  Build:  c++ -std=c++17 -O2 -Iinclude -o stream-decoder scripts/stream-decoder.cpp
+  Usage:  stream-decoder < capture.bin > samples.csv
+
+  The capture can be taken with anything that dumps the raw serial bytes, e.g.
+  stty -F /dev/ttyACM0 raw 115200 && cat /dev/ttyACM0 > capture.bin
+  CLI text in the capture is skipped, as it fails the CRC. Statistics are printed on stderr at the end.
+*/
+
+#include <cstdio>
+#include <iterator>
+#include "SampleStream.h"
+
+using namespace blastic::scale::stream;
+
+static const char *const modeStrings[] = {"A128", "B", "A64"};
+
+static struct {
+  unsigned long frames, badFrames, samples, lost;
+  bool haveIndex;
+  uint32_t nextIndex;
+} stats;
+
+static bool decodeFrame(const uint8_t *frame, size_t size) {
+  if (size < 4 || frame[0] != samplesRecord || frame[1] >= std::size(modeStrings)) return false;
+  uint16_t crc = frame[size - 2] << 8 | frame[size - 1];
+  if (util::crc16(frame, size - 2) != crc) return false;
+  const char *mode = modeStrings[frame[1]];
+  size_t pos = 2, end = size - 2, n;
+  uint32_t index, millis, zigzag;
+  if (!(n = util::getVarint(frame + pos, end - pos, index))) return false;
+  pos += n;
+  if (!(n = util::getVarint(frame + pos, end - pos, millis))) return false;
+  pos += n;
+  if (!(n = util::getVarint(frame + pos, end - pos, zigzag))) return false;
+  pos += n;
+  int32_t value = util::unzigzag(zigzag);
+  if (stats.haveIndex && index > stats.nextIndex) stats.lost += index - stats.nextIndex;
+  for (;;) {
+    printf("%lu,%lu,%s,%ld\n", (unsigned long)index, (unsigned long)millis, mode, (long)value);
+    stats.samples++, index++;
+    if (pos == end) break;
+    uint32_t deltaMillis, deltaValue;
+    if (!(n = util::getVarint(frame + pos, end - pos, deltaMillis))) return false;
+    pos += n;
+    if (!(n = util::getVarint(frame + pos, end - pos, deltaValue))) return false;
+    pos += n;
+    millis += deltaMillis, value += util::unzigzag(deltaValue);
+  }
+  stats.haveIndex = true, stats.nextIndex = index;
+  return true;
+}
+
+int main() {
+  static uint8_t encoded[4096], frame[sizeof(encoded)];
+  size_t size = 0;
+  printf("index,millis,mode,raw\n");
+  for (int c; (c = getchar()) != EOF;) {
+    if (c) {
+      // too long to be a frame, it is text or garbage: drop until the next delimiter
+      if (size < sizeof(encoded)) encoded[size] = c;
+      size++;
+      continue;
+    }
+    if (size && size <= sizeof(encoded)) {
+      auto frameSize = util::cobsDecode(encoded, size, frame);
+      if (frameSize && decodeFrame(frame, frameSize)) stats.frames++;
+      else stats.badFrames++;
+    } else if (size) stats.badFrames++;
+    size = 0;
+  }
+  fprintf(stderr, "frames %lu bad frames %lu samples %lu lost %lu\n", stats.frames, stats.badFrames, stats.samples,
+          stats.lost);
+  return 0;
+}
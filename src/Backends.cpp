@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cstring>
+#include "Backends.h"
+#include "Plastic.h"
+
+namespace blastic {
+
+namespace uploader {
+
+bool FormBackend::configured(const Endpoint &endpoint) const {
+  return strlen(endpoint.urn) && strlen(endpoint.form.type) && strlen(endpoint.form.collectionPoint) &&
+         strlen(endpoint.form.weight) && strlen(identity.collectionPoint);
+}
+
+size_t FormBackend::ready(const Endpoint &, size_t pending, uint32_t, bool, uint32_t &) const {
+  return std::min<size_t>(pending, 1);
+}
+
+bool FormBackend::encode(const Endpoint &endpoint, const journal::Submission *submissions, size_t, uint32_t,
+                         util::http::Writer &body) const {
+  auto &submission = submissions[0];
+  // the space in the plastic type value is encoded as +
+  body.raw(endpoint.form.type).raw('=').number(submission.plastic).raw('+');
+  body.raw(plasticName(plastic(submission.plastic)));
+  body.raw('&').raw(endpoint.form.collectionPoint).raw('=').urlEncoded(identity.collectionPoint);
+  body.raw('&').raw(endpoint.form.weight).raw('=').decimal(submission.weight);
+  body.raw('&').raw(endpoint.form.collectorName).raw('=');
+  body.urlEncoded(strlen(identity.collectorName) ? identity.collectorName : identity.userAgent);
+  return body.ok();
+}
+
+static size_t maxRecords(const Endpoint &endpoint) {
+  return std::clamp<size_t>(endpoint.batch.maxRecords, 1, maxBatch);
+}
+
+bool BatchBackend::configured(const Endpoint &endpoint) const {
+  return strlen(endpoint.urn) && strlen(identity.collectionPoint);
+}
+
+size_t BatchBackend::ready(const Endpoint &endpoint, size_t pending, uint32_t oldestAge, bool flush,
+                           uint32_t &waitSeconds) const {
+  if (pending >= maxRecords(endpoint) || flush || oldestAge >= endpoint.batch.maxAge)
+    return std::min(pending, maxRecords(endpoint));
+  waitSeconds = endpoint.batch.maxAge - oldestAge;
+  return 0;
+}
+
+bool BatchBackend::encode(const Endpoint &, const journal::Submission *submissions, size_t n, uint32_t now,
+                          util::http::Writer &body) const {
+  body.raw("{\"device\":").jsonString(identity.userAgent);
+  body.raw(",\"collectionPoint\":").jsonString(identity.collectionPoint);
+  body.raw(",\"collector\":").jsonString(identity.collectorName).raw("}\n");
+  for (size_t i = 0; i < n; i++) {
+    auto &submission = submissions[i];
+    body.raw("{\"id\":").number(submission.serial).raw(",\"plastic\":").number(submission.plastic);
+    body.raw(",\"type\":").jsonString(plasticName(plastic(submission.plastic)));
+    body.raw(",\"weight\":").decimal(submission.weight, 3);
+    if (submission.thisBoot) body.raw(",\"age\":").number(now - submission.seconds);
+    body.raw("}\n");
+  }
+  return body.ok();
+}
+
+size_t encodeFitting(const Backend &backend, const Endpoint &endpoint, const journal::Submission *submissions,
+                     size_t n, uint32_t now, util::http::Writer &body) {
+  for (; !backend.encode(endpoint, submissions, n, now, body); n /= 2, body.clear())
+    if (n <= 1) return 0;
+  return n;
+}
+
+} // namespace uploader
+
+} // namespace blastic
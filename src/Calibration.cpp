@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "blastic.h"
+#include "Scale.h"
+
+namespace blastic {
+
+namespace scale {
+
+// choose a shift so that value * 2^shift uses about 30 bits
+static int fixedPointShift(double value, int maxShift) {
+  if (value == 0) return maxShift;
+  return std::clamp(int(floor(30 - log2(fabs(value)))), 0, maxShift);
+}
+
+bool Transform::compile(const EEPROMConfig::calibration &calibration) {
+  segments = 0;
+  if (!calibration.points || calibration.points > maxCalibrationPoints) return false;
+  struct {
+    int32_t raw;
+    double weight;
+  } knots[maxCalibrationPoints + 1];
+  size_t n = 0;
+  knots[n++] = {calibration.tareRawRead, 0};
+  for (size_t i = 0; i < calibration.points; i++)
+    knots[n++] = {calibration.weights[i].rawRead, calibration.weights[i].weight};
+  std::sort(knots, knots + n, [](auto &a, auto &b) { return a.raw < b.raw; });
+  double slopes[maxCalibrationPoints];
+  for (size_t i = 0; i < n - 1; i++) {
+    if (knots[i].raw == knots[i + 1].raw) return false;
+    slopes[i] = (knots[i + 1].weight - knots[i].weight) / (double(knots[i + 1].raw) - knots[i].raw);
+  }
+  // largest absolute weight within the raw read range determines the fixed point format
+  double maxWeight = std::max(fabs(knots[0].weight + slopes[0] * (double(rawMin) - knots[0].raw)),
+                              fabs(knots[n - 1].weight + slopes[n - 2] * (double(rawMax) - knots[n - 1].raw)));
+  for (size_t i = 0; i < n; i++) maxWeight = std::max(maxWeight, fabs(knots[i].weight));
+  auto fractionalBits = fixedPointShift(maxWeight, 30);
+  fixedPointUnit = ldexpf(1, -fractionalBits);
+  for (size_t i = 0; i < n - 1; i++) {
+    auto slope = ldexp(slopes[i], fractionalBits);
+    auto shift = fixedPointShift(slope, 62);
+    table[i] = {.rawStart = knots[i].raw,
+                .base = int32_t(lround(ldexp(knots[i].weight, fractionalBits))),
+                .slope = int32_t(llround(ldexp(slope, shift))),
+                .shift = uint8_t(shift)};
+  }
+  segments = n - 1;
+  return true;
+}
+
+int32_t Transform::operator()(int32_t raw) const {
+  // last segment starting at or before raw, the first segment also extends below its start
+  size_t lo = 0, hi = segments;
+  while (hi - lo > 1) {
+    auto mid = (lo + hi) / 2;
+    if (table[mid].rawStart <= raw) lo = mid;
+    else hi = mid;
+  }
+  auto &segment = table[lo];
+  return segment.base + int32_t((int64_t(raw - segment.rawStart) * segment.slope) >> segment.shift);
+}
+
+/*
+  Cache of the compiled transforms, one per mode, tagged with the calibration generation they were compiled from.
+  calibrationChanged() bumps the generation, and the next conversion compiles the transform again under the mutex.
+  Readers do not take the mutex in the steady state: the transform is guarded by a seqlock, whose sequence is odd
+  while the transform is being compiled. A reader that sees it odd waits on the mutex for the compilation to end, and
+  a reader whose sequence changed during the conversion converts again, so a torn transform is never used.
+*/
+
+static std::atomic<uint32_t> calibrationGeneration{1};
+static StaticSemaphore_t transformsMutexBuffer;
+static SemaphoreHandle_t transformsMutex = xSemaphoreCreateMutexStatic(&transformsMutexBuffer);
+static struct {
+  Transform transform;
+  std::atomic<uint32_t> generation{0}, sequence{0};
+} transforms[std::size(modeStrings)];
+
+void calibrationChanged() { calibrationGeneration++; }
+
+// compile the transform if not up to date with generation, or wait for the compilation in progress
+static void compileTransform(const EEPROMConfig::calibration &calibration, HX711Mode mode, uint32_t generation) {
+  auto &cached = transforms[uint8_t(mode)];
+  configASSERT(xSemaphoreTake(transformsMutex, portMAX_DELAY));
+  if (cached.generation != generation) {
+    cached.sequence++;
+    if (!cached.transform.compile(calibration) && debug) MSerial()->print("scale: invalid calibration\n");
+    cached.generation = generation;
+    cached.sequence++;
+  }
+  configASSERT(xSemaphoreGive(transformsMutex));
+}
+
+util::AnnotatedFloat weight(const EEPROMConfig &config, int32_t raw, HX711Mode mode) {
+  auto &cached = transforms[uint8_t(mode)];
+  while (true) {
+    uint32_t generation = calibrationGeneration, sequence = cached.sequence;
+    if (sequence % 2 || cached.generation != generation) {
+      compileTransform(config.calibrations[uint8_t(mode)], mode, generation);
+      continue;
+    }
+    auto &transform = cached.transform;
+    bool valid = transform;
+    float value = valid ? float(transform(raw)) * transform.unit() : 0;
+    if (cached.sequence != sequence) continue;
+    return valid ? util::AnnotatedFloat(value - zeroOffset()) : weightCal;
+  }
+}
+
+} // namespace scale
+
+} // namespace blastic
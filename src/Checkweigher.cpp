@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cmath>
+#include "Checkweigher.h"
+
+namespace blastic {
+
+namespace scale {
+
+// the baseline moves by 1/baselineSamples of the difference at each idle sample
+constexpr const float baselineSamples = 16;
+
+void Checkweigher::reset() {
+  size = next = 0;
+  active = hasBaseline = false;
+}
+
+bool Checkweigher::update(const EEPROMConfig &config, float weight, TickType_t tick) {
+  if (std::isnan(weight)) {
+    reset();
+    return false;
+  }
+  if (!hasBaseline) {
+    baselineWeight = weight, hasBaseline = true;
+    return false;
+  }
+  auto net = weight - baselineWeight;
+  if (!active) {
+    if (net < config.trigger) {
+      baselineWeight += (weight - baselineWeight) / baselineSamples;
+      return false;
+    }
+    active = true, size = next = samples = 0, startTick = tick;
+  } else if (net < config.trigger / 2) {
+    active = false;
+    finish(config);
+    return true;
+  }
+  if (size == capacity) size--;
+  weights[next] = weight;
+  next = (next + 1) % capacity, size++;
+  if (samples < UINT16_MAX) samples++;
+  lastTick = tick;
+  return false;
+}
+
+void Checkweigher::finish(const EEPROMConfig &config) {
+  // longest run of samples within plateauBand, stop when no longer run can start
+  size_t bestStart = 0, bestLength = 0;
+  for (size_t i = 0; i < size && size - i > bestLength; i++) {
+    float lo = weights[index(i)], hi = lo;
+    size_t j = i + 1;
+    for (; j < size; j++) {
+      auto w = weights[index(j)];
+      lo = fminf(lo, w), hi = fmaxf(hi, w);
+      if (hi - lo > config.plateauBand) break;
+    }
+    if (j - i > bestLength) bestStart = i, bestLength = j - i;
+  }
+  float sum = 0;
+  for (size_t i = bestStart; i < bestStart + bestLength; i++) sum += weights[index(i)];
+  lastItem = {.sequence = sequence++,
+              .start = startTick,
+              .end = lastTick,
+              .weight = sum / bestLength - baselineWeight,
+              .samples = samples,
+              .plateauSamples = uint16_t(bestLength),
+              .stable = bestLength >= std::max<size_t>(config.minPlateauSamples, 1)};
+}
+
+} // namespace scale
+
+} // namespace blastic
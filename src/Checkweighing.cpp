@@ -0,0 +1,71 @@
+#include <atomic>
+#include "blastic.h"
+#include "Scale.h"
+#include "RingLog.h"
+#include "StaticTask.h"
+
+namespace blastic {
+
+namespace scale {
+
+/*
+  Checkweigher task and item log.
+*/
+
+static util::RingLog<Checkweigher::Item, 32> items;
+
+static struct {
+  std::atomic<const EEPROMConfig *> config{nullptr};
+  TaskHandle_t task = nullptr;
+} checkweighing;
+
+static void checkweigherLoop() [[noreturn]] {
+  // while the continuous acquisition is not running, check again every stallMillis
+  constexpr const uint32_t stallMillis = 500;
+  static Checkweigher segmenter;
+  while (true) {
+    const EEPROMConfig *config;
+    while (!(config = checkweighing.config)) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    segmenter.reset();
+    for (auto cursor = sampleCursor(); checkweighing.config == config;) {
+      Sample sample;
+      if (!nextSample(*config, cursor, sample, pdMS_TO_TICKS(stallMillis))) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(stallMillis));
+        segmenter.reset();
+        cursor = sampleCursor();
+        continue;
+      }
+      if (sample.mode != config->mode && !autoRanging(*config)) continue;
+      if (!segmenter.update(config->checkweighing, weight(*config, sample.value, sample.mode), sample.tick)) continue;
+      auto &item = segmenter.item();
+      items.push(item);
+      if (debug) {
+        MSerial serial;
+        serial->print("checkweigher: item ");
+        serial->print(item.sequence);
+        serial->print(" weight ");
+        serial->print(item.weight, 3);
+        serial->print(item.stable ? " stable" : " unstable");
+        serial->print(" samples ");
+        serial->print(item.samples);
+        serial->print(" plateau ");
+        serial->println(item.plateauSamples);
+      }
+    }
+  }
+}
+
+void checkweigher(const EEPROMConfig &config) {
+  static util::StaticTask<1024> task;
+  if (!task) checkweighing.task = task.init(checkweigherLoop, "Checkweigher", configMAX_PRIORITIES - 3);
+  checkweighing.config = config.checkweigher ? &config : nullptr;
+  xTaskNotifyGive(checkweighing.task);
+}
+
+uint32_t checkweighedItems() { return items.count(); }
+
+bool checkweighedItem(uint32_t i, Checkweigher::Item &item) { return items.read(i, item); }
+
+} // namespace scale
+
+} // namespace blastic
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include "Fanout.h"
+#include "utils.h"
+
+namespace blastic {
+
+namespace uploader {
+
+Fanout::Fanout(const Endpoint (&endpoints)[journal::maxEndpoints], const Identity &identity,
+               Transport *const (&transports)[journal::maxEndpoints])
+    : endpoints(endpoints), identity(identity), form(identity), batch(identity) {
+  for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++)
+    deliveries[endpoint].transport = transports[endpoint];
+}
+
+void Fanout::log(bool always, const char *format, ...) const {
+  if (!always && !debugging()) return;
+  char text[128];
+  va_list args;
+  va_start(args, format);
+  auto len = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (len > 0) print(text, std::min<size_t>(len, sizeof(text) - 1));
+}
+
+// the backend of an endpoint, nullptr if disabled or not configured
+const Backend *Fanout::backend(uint8_t endpoint) const {
+  auto &config = endpoints[endpoint];
+  const Backend *backend = nullptr;
+  switch (config.backend) {
+  case Endpoint::Backend::FORM: backend = &form; break;
+  case Endpoint::Backend::BATCH: backend = &batch; break;
+  default: break;
+  }
+  return backend && backend->configured(config) ? backend : nullptr;
+}
+
+uint8_t Fanout::active() const {
+  uint8_t mask = 0;
+  for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++)
+    if (backend(endpoint)) mask |= 1 << endpoint;
+  return mask;
+}
+
+TickType_t Fanout::nextCheck() const {
+  auto now = xTaskGetTickCount();
+  TickType_t wait = portMAX_DELAY;
+  for (auto &delivery : deliveries)
+    if (delivery.scheduled)
+      wait = std::min(wait, int32_t(delivery.nextAttempt - now) > 0 ? delivery.nextAttempt - now : 0);
+  return wait;
+}
+
+void Fanout::submitted(uint32_t serial, TickType_t tick) {
+  taskENTER_CRITICAL();
+  lastSubmission = {.serial = serial, .tick = tick};
+  taskEXIT_CRITICAL();
+}
+
+void Fanout::disconnect(Delivery &delivery) {
+  delivery.transport->stop();
+  delivery.reusable = false;
+}
+
+void Fanout::disconnectAll() {
+  for (auto &delivery : deliveries) {
+    if (delivery.reusable) log(false, "uploader: closing connection before wifi disconnects\n");
+    disconnect(delivery);
+  }
+}
+
+// returns false if the handshake failed, delivery.reused is set if the open connection can be used
+bool Fanout::connect(Delivery &delivery, const char *host) {
+  delivery.reused = delivery.reusable && !strcmp(delivery.host, host) && delivery.transport->connected();
+  if (delivery.reused) {
+    delivery.stats.reuses++;
+    return true;
+  }
+  disconnect(delivery);
+  if (!delivery.transport->connect(host, httpsPort)) return false;
+  strcpy0(delivery.host, host);
+  delivery.stats.handshakes++;
+  return true;
+}
+
+// the endpoint should be checked now: its schedule expired, or the task was woken
+bool Fanout::eligible(uint8_t endpoint, bool woken) const {
+  auto &delivery = deliveries[endpoint];
+  if (delivery.inFlight) return false;
+  return woken || (delivery.scheduled && int32_t(delivery.nextAttempt - xTaskGetTickCount()) <= 0);
+}
+
+// how many submissions the endpoint should send now, otherwise schedule its next check
+size_t Fanout::ready(uint8_t endpoint) {
+  auto &delivery = deliveries[endpoint];
+  delivery.scheduled = false;
+  auto backend = Fanout::backend(endpoint);
+  if (!backend) return 0;
+  auto pending = journal::front(endpoint, submissions, maxBatch);
+  if (!pending) {
+    flushRequested &= ~(1 << endpoint);
+    return 0;
+  }
+  uint32_t now = xTaskGetTickCount() / configTICK_RATE_HZ;
+  uint32_t oldestAge = submissions[0].thisBoot ? now - submissions[0].seconds : UINT32_MAX, waitSeconds = 0;
+  bool flush = flushRequested & (1 << endpoint);
+  auto n = backend->ready(endpoints[endpoint], pending, oldestAge, flush, waitSeconds);
+  if (!n) {
+    delivery.scheduled = true;
+    delivery.nextAttempt = xTaskGetTickCount() + pdMS_TO_TICKS(waitSeconds * 1000);
+    return 0;
+  }
+  delivery.firstSerial = submissions[0].serial, delivery.lastSerial = submissions[n - 1].serial, delivery.n = n;
+  return n;
+}
+
+uint8_t Fanout::due(bool woken) {
+  uint8_t wanting = 0;
+  for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++)
+    if (eligible(endpoint, woken) && ready(endpoint)) wanting |= 1 << endpoint;
+  return wanting;
+}
+
+void Fanout::fail(uint8_t wanting, int status) {
+  for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++) {
+    if (!(wanting & (1 << endpoint))) continue;
+    deliveries[endpoint].reused = false;
+    finish(endpoint, status, wanting);
+  }
+}
+
+// copy the host part of urn to serverAddress, and return the path
+static const char *splitUrn(const char *urn, decltype(Endpoint::urn) &serverAddress) {
+  auto path = strchr(urn, '/');
+  if (!path) {
+    strcpy0(serverAddress, urn);
+    return "/";
+  }
+  strcpy0(serverAddress, urn, path - urn);
+  return path;
+}
+
+// client errors that a retry cannot fix, except timeouts and rate limiting
+static bool permanentError(int status) { return status >= 400 && status < 500 && status != 408 && status != 429; }
+
+// handle the result of the request of an endpoint, adding the endpoint to wanting if it should send again now
+void Fanout::finish(uint8_t endpoint, int status, uint8_t &wanting) {
+  auto &delivery = deliveries[endpoint];
+  delivery.inFlight = false;
+  if (status < 0) disconnect(delivery);
+  // the server may have closed the reused connection after we checked, try once more on a new one
+  if (status < 0 && delivery.reused && !delivery.retried) {
+    log(false, "uploader: reused connection failed, reconnecting\n");
+    delivery.retried = true;
+    wanting |= 1 << endpoint;
+    return;
+  }
+  delivery.retried = false;
+  delivery.stats.lastStatus = status;
+  bool done = status >= 200 && status < 300, drop = permanentError(status);
+  log(drop, "uploader: endpoint %u submissions %" PRIu32 " to %" PRIu32 " %s, status %d\n", endpoint,
+      delivery.firstSerial, delivery.lastSerial, done ? "uploaded" : drop ? "dropped" : "failed", status);
+  if ((done || drop) && journal::ack(endpoint, delivery.lastSerial)) {
+    (done ? delivery.stats.uploaded : delivery.stats.dropped) += delivery.n;
+    taskENTER_CRITICAL();
+    auto submission = lastSubmission;
+    taskEXIT_CRITICAL();
+    if (done && submission.serial >= delivery.firstSerial && submission.serial <= delivery.lastSerial) {
+      delivery.stats.latency = (xTaskGetTickCount() - submission.tick) * portTICK_PERIOD_MS;
+      log(false, "uploader: endpoint %u delivered the last submission in %" PRIu32 "ms\n", endpoint,
+          delivery.stats.latency);
+    }
+    delivery.stats.backoff = 0;
+    // send the next ones, if any
+    wanting |= 1 << endpoint;
+    return;
+  }
+  delivery.stats.failures++;
+  delivery.stats.backoff = std::clamp(2 * delivery.stats.backoff, minBackoff, maxBackoff);
+  delivery.scheduled = true;
+  delivery.nextAttempt = xTaskGetTickCount() + pdMS_TO_TICKS(delivery.stats.backoff * 1000);
+}
+
+// send the request for the n submissions found by ready(endpoint)
+void Fanout::start(uint8_t endpoint, size_t n, uint8_t &wanting) {
+  auto &delivery = deliveries[endpoint];
+  auto &config = endpoints[endpoint];
+  auto &backend = *Fanout::backend(endpoint);
+  delivery.reused = false;
+  decltype(Endpoint::urn) serverAddress;
+  auto path = splitUrn(config.urn, serverAddress);
+  // shared by the endpoints, the body is written out before the next request is encoded
+  static char bodyBuffer[2048];
+  util::http::Writer body(bodyBuffer);
+  // send fewer submissions if they do not fit, the rest go in the next request
+  n = encodeFitting(backend, config, submissions, n, xTaskGetTickCount() / configTICK_RATE_HZ, body);
+  if (!n) return finish(endpoint, configError, wanting);
+  delivery.lastSerial = submissions[n - 1].serial, delivery.n = n;
+
+  if (!connect(delivery, serverAddress)) {
+    log(false, "uploader: failed to connect to server\n");
+    return finish(endpoint, tlsError, wanting);
+  }
+  char head[384];
+  util::http::Writer request(head);
+  request.raw("POST ").raw(path).raw(" HTTP/1.1\r\nHost: ").raw(serverAddress);
+  request.raw("\r\nUser-Agent: ").raw(identity.userAgent);
+  request.raw("\r\nContent-Type: ").raw(backend.contentType()).raw("\r\nContent-Length: ").number(body.length());
+  request.raw("\r\nAccept: */*\r\nConnection: keep-alive\r\n\r\n");
+  if (!request.ok()) return finish(endpoint, configError, wanting);
+  delivery.stats.requests++;
+  auto &transport = *delivery.transport;
+  if (transport.write(reinterpret_cast<const uint8_t *>(request.data()), request.length()) != request.length() ||
+      transport.write(reinterpret_cast<const uint8_t *>(body.data()), body.length()) != body.length())
+    return finish(endpoint, tlsError, wanting);
+  delivery.response = {};
+  delivery.inFlight = true;
+  delivery.sentTick = xTaskGetTickCount();
+}
+
+// read what is available of the response of an endpoint, returns true if anything was read
+bool Fanout::poll(uint8_t endpoint, uint8_t &wanting) {
+  auto &delivery = deliveries[endpoint];
+  auto &response = delivery.response;
+  auto onHeader = [this](const char *name, const char *value) {
+    log(false, "uploader::response: %s: %s\n", name, value);
+  };
+  auto onBody = [this](const uint8_t *data, size_t size) {
+    if (debugging()) print(reinterpret_cast<const char *>(data), size);
+  };
+  // the client fetches a whole modem transfer at once, and serves this from its buffer
+  uint8_t chunk[128];
+  auto len = delivery.transport->read(chunk, sizeof(chunk));
+  if (len > 0) response.feed(chunk, len, onHeader, onBody);
+  // a body without length ends when the server closes the connection
+  if (!response.done() && !response.error() && (len > 0 || delivery.transport->connected()) &&
+      xTaskGetTickCount() - delivery.sentTick < pdMS_TO_TICKS(responseTimeout))
+    return len > 0;
+  log(false, "\nuploader::response: endpoint %u status %d\n", endpoint, response.status());
+  // reuse the connection only if the response has been read completely
+  delivery.reusable = response.done() && !response.mustClose();
+  finish(endpoint, response.status() ? response.status() : responseError, wanting);
+  return len > 0;
+}
+
+void Fanout::warmUp() {
+  for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++) {
+    auto &delivery = deliveries[endpoint];
+    if (!backend(endpoint) || delivery.inFlight) continue;
+    decltype(Endpoint::urn) serverAddress;
+    splitUrn(endpoints[endpoint].urn, serverAddress);
+    if (!connect(delivery, serverAddress)) {
+      log(false, "uploader: prewarm failed to connect to server\n");
+      continue;
+    }
+    // the connection was not used, do not count it as reused
+    if (delivery.reused) delivery.stats.reuses--;
+    delivery.reusable = true;
+  }
+}
+
+void Fanout::deliver(uint8_t wanting) {
+  while (true) {
+    // new submissions, or the retry of an endpoint while the others are still busy
+    bool notified = ulTaskNotifyTake(pdTRUE, 0);
+    bool inFlight = false, progress = false;
+    for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++) {
+      if (eligible(endpoint, notified)) wanting |= 1 << endpoint;
+      if (wanting & (1 << endpoint)) {
+        wanting &= ~(1 << endpoint);
+        if (auto n = ready(endpoint)) start(endpoint, n, wanting);
+      }
+      if (deliveries[endpoint].inFlight) progress |= poll(endpoint, wanting);
+      inFlight |= deliveries[endpoint].inFlight;
+    }
+    if (!inFlight && !wanting) return;
+    if (!progress) vTaskDelay(pdMS_TO_TICKS(pollMillis));
+  }
+}
+
+} // namespace uploader
+
+} // namespace blastic
@@ -0,0 +1,87 @@
+#include "blastic.h"
+#include "Scale.h"
+#include "HX711.h"
+
+namespace blastic {
+
+namespace scale {
+
+namespace hx711 {
+
+/*
+  The timer interrupt alternates between raising SCK, and sampling DT then lowering SCK. The HX711 powers down if SCK
+  stays high for more than 60us, so the half period must stay well below that even with some interrupt latency.
+*/
+constexpr const float halfPeriodFrequency = 100000;
+
+static FspTimer timer;
+static StaticSemaphore_t frameDoneBuffer;
+static SemaphoreHandle_t frameDone = xSemaphoreCreateBinaryStatic(&frameDoneBuffer);
+
+// accessed by the interrupt only while the timer is running
+static struct {
+  RuntimePin sck, dts[maxChannels];
+  uint32_t values[maxChannels];
+  uint8_t channels, pulse, pulses;
+  bool high;
+} frame;
+
+static TimerStats stats;
+
+static void timerCallback(timer_callback_args_t *) {
+  if (!frame.high) {
+    if (frame.pulse == frame.pulses) {
+      timer.stop();
+      BaseType_t woken = pdFALSE;
+      xSemaphoreGiveFromISR(frameDone, &woken);
+      portYIELD_FROM_ISR(woken);
+      return;
+    }
+    frame.sck.high();
+    frame.high = true;
+    return;
+  }
+  if (frame.pulse < 24)
+    for (uint8_t c = 0; c < frame.channels; c++) frame.values[c] = frame.values[c] << 1 | frame.dts[c].read();
+  frame.sck.low();
+  frame.high = false;
+  frame.pulse++;
+}
+
+bool timerAvailable() {
+  static bool open = [] {
+    uint8_t type;
+    auto channel = FspTimer::get_available_timer(type);
+    return channel >= 0 && timer.begin(TIMER_MODE_PERIODIC, type, channel, halfPeriodFrequency, 0.0f, timerCallback) &&
+           timer.setup_overflow_irq() && timer.open();
+  }();
+  return open;
+}
+
+bool timerClockBits(uint8_t sck, const uint8_t *dts, uint8_t channels, uint8_t pulses, uint32_t *values) {
+  configASSERT(timerAvailable() && channels <= maxChannels);
+  frame.sck = RuntimePin(sck);
+  for (uint8_t c = 0; c < channels; c++) frame.dts[c] = RuntimePin(dts[c]), frame.values[c] = 0;
+  frame.channels = channels, frame.pulse = 0, frame.pulses = pulses, frame.high = false;
+  auto startCycles = DWT->CYCCNT;
+  xSemaphoreTake(frameDone, 0);
+  timer.start();
+  // a frame takes 2 * pulses half periods, that is less than 1ms
+  constexpr const uint32_t frameTimeout = 10;
+  if (!xSemaphoreTake(frameDone, max(pdMS_TO_TICKS(frameTimeout), 1))) {
+    timer.stop();
+    stats.failures++;
+    return false;
+  }
+  stats.lastCycles = DWT->CYCCNT - startCycles, stats.frames++;
+  std::copy(frame.values, frame.values + channels, values);
+  return true;
+}
+
+TimerStats timerStats() { return stats; }
+
+} // namespace hx711
+
+} // namespace scale
+
+} // namespace blastic
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include "blastic.h"
+#include "History.h"
+#include "Framing.h"
+
+namespace blastic {
+
+namespace history {
+
+static StaticSemaphore_t mutexBuffer;
+static SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+
+// record in resolution units
+struct Quantized {
+  uint32_t second, seconds;
+  int32_t min, max, mean;
+  bool sameAggregate(const Quantized &o) const { return min == o.min && max == o.max && mean == o.mean; }
+};
+
+constexpr const size_t maxRecordSize = 5 * util::maxVarintSize;
+
+static struct {
+  uint8_t data[blocks][blockSize];
+  uint16_t used[blocks];
+  // absolute block indexes, the block of index i is data[i % blocks]
+  uint32_t head = 0, oldest = 0;
+  // last record written in the head block
+  Quantized headPrevious{};
+  // record still being extended, and aggregate of the current interval
+  Quantized pending;
+  bool hasPending = false;
+  struct {
+    uint32_t second, count;
+    int32_t min, max;
+    int64_t sum;
+  } current{};
+  // last tick seen, extended past the TickType_t wrap (about 49.7 days at 1kHz)
+  uint64_t tick = 0;
+} ring;
+
+// seconds since boot of tick, which may be a bit older than the last one seen (readings from other tasks)
+static uint32_t second(TickType_t tick) {
+  auto delta = std::make_signed_t<TickType_t>(tick - TickType_t(ring.tick));
+  if (delta > 0) ring.tick += delta;
+  return (delta < 0 ? ring.tick + delta : ring.tick) / configTICK_RATE_HZ;
+}
+
+static size_t encode(const Quantized &record, uint32_t previousSecond, int32_t previousMin, uint8_t *out) {
+  size_t n = 0;
+  n += util::putVarint(out + n, (record.second - previousSecond) / interval);
+  n += util::putVarint(out + n, record.seconds / interval - 1);
+  n += util::putVarint(out + n, util::zigzag(record.min - previousMin));
+  n += util::putVarint(out + n, record.max - record.min);
+  n += util::putVarint(out + n, record.mean - record.min);
+  return n;
+}
+
+static size_t decode(const uint8_t *in, size_t size, uint32_t previousSecond, int32_t previousMin, Quantized &record) {
+  uint32_t fields[5];
+  size_t n = 0;
+  for (auto &field : fields) {
+    auto fieldSize = util::getVarint(in + n, size - n, field);
+    if (!fieldSize) return 0;
+    n += fieldSize;
+  }
+  record.second = previousSecond + fields[0] * interval, record.seconds = (fields[1] + 1) * interval;
+  record.min = previousMin + util::unzigzag(fields[2]);
+  record.max = record.min + fields[3], record.mean = record.min + fields[4];
+  return n;
+}
+
+static void write(const Quantized &record) {
+  uint8_t encoded[maxRecordSize];
+  auto size = encode(record, ring.headPrevious.second, ring.headPrevious.min, encoded);
+  if (ring.used[ring.head % blocks] + size > blockSize) {
+    // start a new block with an absolute record, dropping the oldest block if the ring is full
+    ring.head++;
+    if (ring.head - ring.oldest == blocks) ring.oldest++;
+    ring.used[ring.head % blocks] = 0;
+    size = encode(record, 0, 0, encoded);
+  }
+  std::copy(encoded, encoded + size, ring.data[ring.head % blocks] + ring.used[ring.head % blocks]);
+  ring.used[ring.head % blocks] += size;
+  ring.headPrevious = record;
+}
+
+static void closeInterval() {
+  auto &current = ring.current;
+  Quantized record{.second = current.second,
+                   .seconds = interval,
+                   .min = current.min,
+                   .max = current.max,
+                   .mean = int32_t(lround(double(current.sum) / current.count))};
+  current.count = 0;
+  auto &pending = ring.pending;
+  if (ring.hasPending && pending.second + pending.seconds == record.second && pending.sameAggregate(record)) {
+    pending.seconds += interval;
+    return;
+  }
+  if (ring.hasPending) write(pending);
+  pending = record, ring.hasPending = true;
+}
+
+void append(util::AnnotatedFloat weight, TickType_t tick) {
+  if (std::isnan(weight)) return;
+  auto value = int32_t(lroundf(weight / resolution));
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  uint32_t second = history::second(tick) / interval * interval;
+  auto &current = ring.current;
+  if (current.count && current.second != second) closeInterval();
+  if (!current.count) current = {.second = second, .count = 0, .min = value, .max = value, .sum = 0};
+  current.min = min(current.min, value), current.max = max(current.max, value);
+  current.sum += value, current.count++;
+  configASSERT(xSemaphoreGive(mutex));
+}
+
+static Record toRecord(const Quantized &q) {
+  return {.second = q.second,
+          .seconds = q.seconds,
+          .min = q.min * resolution,
+          .max = q.max * resolution,
+          .mean = q.mean * resolution};
+}
+
+bool next(Cursor &cursor, Record &record) {
+  if (cursor.done) return false;
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  // the block has been dropped, skip to the oldest one
+  if (cursor.block < ring.oldest) cursor = {.block = ring.oldest};
+  bool found = false;
+  while (true) {
+    auto block = cursor.block % blocks;
+    Quantized q;
+    size_t size;
+    if (cursor.offset < ring.used[block] &&
+        (size = decode(ring.data[block] + cursor.offset, ring.used[block] - cursor.offset, cursor.second, cursor.min,
+                       q))) {
+      cursor.offset += size, cursor.second = q.second, cursor.min = q.min;
+      record = toRecord(q), found = true;
+      break;
+    }
+    if (cursor.block == ring.head) {
+      if (ring.hasPending) record = toRecord(ring.pending), found = true;
+      cursor.done = true;
+      break;
+    }
+    cursor = {.block = cursor.block + 1};
+  }
+  configASSERT(xSemaphoreGive(mutex));
+  return found;
+}
+
+Stats stats(uint32_t lastSeconds) {
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  uint32_t now = second(xTaskGetTickCount()), from = now > lastSeconds ? now - lastSeconds : 0;
+  configASSERT(xSemaphoreGive(mutex));
+  Stats stats{.seconds = 0, .min = NAN, .max = NAN, .mean = NAN};
+  double sum = 0;
+  Record record;
+  for (Cursor cursor; next(cursor, record);) {
+    auto start = max(record.second, from), end = min(record.second + record.seconds, now + 1);
+    if (start >= end) continue;
+    stats.min = stats.seconds ? min(stats.min, record.min) : record.min;
+    stats.max = stats.seconds ? max(stats.max, record.max) : record.max;
+    stats.seconds += end - start, sum += double(record.mean) * (end - start);
+  }
+  if (stats.seconds) stats.mean = sum / stats.seconds;
+  return stats;
+}
+
+size_t bytesUsed() {
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  size_t used = 0;
+  for (auto block = ring.oldest; block <= ring.head; block++) used += ring.used[block % blocks];
+  configASSERT(xSemaphoreGive(mutex));
+  return used;
+}
+
+} // namespace history
+
+} // namespace blastic
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cstring>
+#include <Arduino_FreeRTOS.h>
+#include <r_flash_lp.h>
+#include "Journal.h"
+#include "Framing.h"
+
+namespace blastic {
+
+namespace journal {
+
+// the host tests replace the data flash with an array
+#ifdef BLASTIC_DATA_FLASH_START
+static const uintptr_t dataFlashStart = BLASTIC_DATA_FLASH_START;
+#else
+constexpr const uintptr_t dataFlashStart = 0x40100000;
+#endif
+constexpr const size_t blockSize = 1024, blocks = 8;
+
+enum : uint8_t { submissionRecord = 1, ackRecord = 2 };
+
+struct [[gnu::packed]] Record {
+  // for ack records, plastic is the endpoint index
+  uint8_t type : 4, plastic : 4;
+  // low byte of the boot count when written
+  uint8_t boot;
+  uint16_t crc;
+  uint32_t serial;
+  union {
+    float weight;
+    // for ack records, serial of the last submission done
+    uint32_t acked;
+  };
+  uint32_t seconds;
+
+  uint16_t checksum() const {
+    auto copy = *this;
+    copy.crc = 0;
+    return util::crc16(reinterpret_cast<const uint8_t *>(&copy), sizeof(copy));
+  }
+  bool valid() const { return (type == submissionRecord || type == ackRecord) && crc == checksum(); }
+};
+static_assert(sizeof(Record) == 16, "journal record must be 16 bytes");
+
+constexpr const size_t blockSlots = blockSize / sizeof(Record), slots = blocks * blockSlots;
+
+static StaticSemaphore_t mutexBuffer;
+static SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+
+// these variables must be accessed while holding the mutex above
+static struct {
+  flash_lp_instance_ctrl_t flash;
+  bool open = false;
+  // slot of the next write, oldest block in use and number of blocks in use (from oldest to the block of head)
+  size_t head = 0, oldest = 0, usedBlocks = 0;
+  uint32_t nextSerial = 1, acked[maxEndpoints] = {};
+  uint8_t boot = 0, active = (1 << maxEndpoints) - 1;
+  bool activeSet = false;
+  // submissions not acked by some active endpoint
+  size_t pending = 0;
+  uint32_t writeErrors = 0;
+} journal;
+
+// submissions up to this serial are done for all the active endpoints
+static uint32_t doneSerial() {
+  auto done = UINT32_MAX;
+  for (uint8_t endpoint = 0; endpoint < maxEndpoints; endpoint++)
+    if (journal.active & (1 << endpoint)) done = std::min(done, journal.acked[endpoint]);
+  return done;
+}
+
+static uintptr_t slotAddress(size_t slot) { return dataFlashStart + slot * sizeof(Record); }
+
+// the data flash is memory mapped for reads
+static const Record &slotRecord(size_t slot) { return *reinterpret_cast<const Record *>(slotAddress(slot)); }
+
+static size_t count(uint32_t after) {
+  size_t count = 0;
+  for (size_t slot = 0; slot < slots; slot++) {
+    auto &record = slotRecord(slot);
+    count += record.valid() && record.type == submissionRecord && record.serial > after;
+  }
+  return count;
+}
+
+static bool blank(uintptr_t address, size_t size) {
+  flash_result_t result{};
+  return R_FLASH_LP_BlankCheck(&journal.flash, address, size, &result) == FSP_SUCCESS && result == FLASH_RESULT_BLANK;
+}
+
+// a block can be reclaimed if all its submissions are done
+static bool reclaimable(size_t block) {
+  auto done = doneSerial();
+  for (size_t slot = block * blockSlots; slot < (block + 1) * blockSlots; slot++) {
+    auto &record = slotRecord(slot);
+    if (record.valid() && record.type == submissionRecord && record.serial > done) return false;
+  }
+  return true;
+}
+
+// prepare a block for writing, reclaiming the oldest one if the ring is full
+static bool enter(size_t block) {
+  if (journal.usedBlocks == blocks) {
+    if (!reclaimable(journal.oldest)) return false;
+    journal.oldest = (journal.oldest + 1) % blocks, journal.usedBlocks--;
+  }
+  if (!blank(dataFlashStart + block * blockSize, blockSize) &&
+      R_FLASH_LP_Erase(&journal.flash, dataFlashStart + block * blockSize, 1) != FSP_SUCCESS) {
+    journal.writeErrors++;
+    return false;
+  }
+  if (!journal.usedBlocks) journal.oldest = block;
+  journal.usedBlocks++;
+  return true;
+}
+
+static bool write(Record &record) {
+  if (!journal.open) return false;
+  record.boot = journal.boot, record.serial = journal.nextSerial;
+  record.seconds = xTaskGetTickCount() / configTICK_RATE_HZ;
+  record.crc = record.checksum();
+  // skip the slots that are not blank, e.g. torn writes, for at most a block
+  for (size_t attempts = 0; attempts <= blockSlots; attempts++) {
+    auto slot = journal.head;
+    if (!(slot % blockSlots) && !enter(slot / blockSlots)) return false;
+    journal.head = (slot + 1) % slots;
+    if (!blank(slotAddress(slot), sizeof(Record))) continue;
+    if (R_FLASH_LP_Write(&journal.flash, uintptr_t(&record), slotAddress(slot), sizeof(Record)) == FSP_SUCCESS &&
+        !memcmp(&slotRecord(slot), &record, sizeof(Record))) {
+      journal.nextSerial++;
+      return true;
+    }
+    journal.writeErrors++;
+  }
+  return false;
+}
+
+bool begin() {
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  journal = {};
+  flash_cfg_t config{};
+  config.data_flash_bgo = false;
+  config.irq = FSP_INVALID_VECTOR;
+  journal.open = R_FLASH_LP_Open(&journal.flash, &config) == FSP_SUCCESS;
+  if (!journal.open) {
+    configASSERT(xSemaphoreGive(mutex));
+    return false;
+  }
+  // the newest record gives the write position, the newest ack the submissions done
+  bool found = false;
+  size_t newest = 0;
+  uint32_t newestAck[maxEndpoints] = {};
+  for (size_t slot = 0; slot < slots; slot++) {
+    auto &record = slotRecord(slot);
+    if (!record.valid()) continue;
+    if (!found || record.serial > slotRecord(newest).serial) newest = slot, found = true;
+    if (record.type != ackRecord || record.plastic >= maxEndpoints || record.serial < newestAck[record.plastic])
+      continue;
+    newestAck[record.plastic] = record.serial, journal.acked[record.plastic] = record.acked;
+  }
+  if (found) {
+    auto &last = slotRecord(newest);
+    journal.nextSerial = last.serial + 1, journal.boot = last.boot + 1;
+    journal.head = (newest + 1) % slots;
+    // the oldest block in use is the first one after the newest record that holds any record
+    size_t newestBlock = newest / blockSlots;
+    journal.oldest = newestBlock;
+    for (size_t i = 1; i < blocks; i++) {
+      auto block = (newestBlock + i) % blocks;
+      bool used = false;
+      for (size_t slot = block * blockSlots; !used && slot < (block + 1) * blockSlots; slot++)
+        used = slotRecord(slot).valid();
+      if (used) {
+        journal.oldest = block;
+        break;
+      }
+    }
+    journal.usedBlocks = (newestBlock + blocks - journal.oldest) % blocks + 1;
+    journal.pending = count(doneSerial());
+  }
+  configASSERT(xSemaphoreGive(mutex));
+  return true;
+}
+
+uint32_t append(uint8_t plastic, float weight) {
+  Record record{};
+  record.type = submissionRecord, record.plastic = plastic, record.weight = weight;
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  bool written = write(record);
+  if (written) journal.pending++;
+  configASSERT(xSemaphoreGive(mutex));
+  return written ? record.serial : 0;
+}
+
+void endpoints(uint8_t mask) {
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  if (journal.activeSet && mask == journal.active) {
+    configASSERT(xSemaphoreGive(mutex));
+    return;
+  }
+  // the endpoints enabled since the last call skip the submissions made while they were not active
+  auto activated = journal.activeSet ? mask & ~journal.active : 0;
+  journal.active = mask, journal.activeSet = true;
+  for (uint8_t endpoint = 0; endpoint < maxEndpoints; endpoint++) {
+    if (!(activated & (1 << endpoint))) continue;
+    Record record{};
+    record.type = ackRecord, record.plastic = endpoint, record.acked = journal.nextSerial - 1;
+    if (write(record)) journal.acked[endpoint] = record.acked;
+  }
+  journal.pending = count(doneSerial());
+  configASSERT(xSemaphoreGive(mutex));
+}
+
+size_t front(uint8_t endpoint, Submission *submissions, size_t max) {
+  configASSERT(endpoint < maxEndpoints);
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  size_t found = 0;
+  auto acked = journal.acked[endpoint];
+  // the records are in write order starting from the oldest block
+  for (size_t i = 0; journal.open && found < max && i < journal.usedBlocks * blockSlots; i++) {
+    auto slot = (journal.oldest * blockSlots + i) % slots;
+    auto &record = slotRecord(slot);
+    if (!record.valid() || record.type != submissionRecord || record.serial <= acked) continue;
+    submissions[found++] = {.serial = record.serial,
+                            .plastic = record.plastic,
+                            .weight = record.weight,
+                            .seconds = record.seconds,
+                            .thisBoot = record.boot == journal.boot};
+  }
+  configASSERT(xSemaphoreGive(mutex));
+  return found;
+}
+
+bool ack(uint8_t endpoint, uint32_t serial) {
+  configASSERT(endpoint < maxEndpoints);
+  Record record{};
+  record.type = ackRecord, record.plastic = endpoint, record.acked = serial;
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  bool written = write(record);
+  if (written) {
+    journal.acked[endpoint] = serial;
+    // few records, recount rather than track which ones were acked
+    journal.pending = count(doneSerial());
+  }
+  configASSERT(xSemaphoreGive(mutex));
+  return written;
+}
+
+Stats stats() {
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  Stats stats{.pending = journal.pending, .freeSlots = 0, .writeErrors = journal.writeErrors};
+  if (journal.open) {
+    // free blocks plus the rest of the head block
+    stats.freeSlots = (blocks - journal.usedBlocks) * blockSlots;
+    if (journal.usedBlocks && journal.head % blockSlots) stats.freeSlots += blockSlots - journal.head % blockSlots;
+  }
+  configASSERT(xSemaphoreGive(mutex));
+  return stats;
+}
+
+size_t pending(uint8_t endpoint) {
+  configASSERT(endpoint < maxEndpoints);
+  configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+  auto pending = journal.open ? count(journal.acked[endpoint]) : 0;
+  configASSERT(xSemaphoreGive(mutex));
+  return pending;
+}
+
+} // namespace journal
+
+} // namespace blastic
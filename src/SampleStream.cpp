@@ -0,0 +1,125 @@
+#include <atomic>
+#include "blastic.h"
+#include "Scale.h"
+#include "SampleStream.h"
+#include "StaticTask.h"
+
+namespace blastic {
+
+namespace scale {
+
+namespace stream {
+
+// frames are flushed at least every flushMillis, to keep the latency low at slow output rates
+constexpr const uint32_t flushMillis = 100;
+
+/*
+  Frame under construction, see SampleStream.h for the format. Samples are delta encoded as they are appended, so the
+  frame only keeps the encoded bytes.
+*/
+class Frame {
+  uint8_t data[maxFrameSize];
+  size_t size = 0, samples = 0;
+  uint32_t nextIndex = 0, lastMillis = 0;
+  int32_t lastValue = 0;
+  HX711Mode mode = HX711Mode::A128;
+
+public:
+  size_t count() const { return samples; }
+
+  // returns false if the sample does not belong to this frame (full, different mode, or not consecutive)
+  bool append(uint32_t index, const Sample &sample) {
+    uint32_t millis = sample.tick * portTICK_PERIOD_MS;
+    if (!samples) {
+      data[0] = samplesRecord, data[1] = uint8_t(sample.mode), size = 2;
+      size += util::putVarint(data + size, index);
+      size += util::putVarint(data + size, millis);
+      size += util::putVarint(data + size, util::zigzag(sample.value));
+      mode = sample.mode;
+    } else {
+      if (samples == maxFrameSamples || sample.mode != mode || index != nextIndex) return false;
+      size += util::putVarint(data + size, millis - lastMillis);
+      size += util::putVarint(data + size, util::zigzag(sample.value - lastValue));
+    }
+    samples++, nextIndex = index + 1, lastMillis = millis, lastValue = sample.value;
+    return true;
+  }
+
+  // append the CRC, COBS encode between 0 delimiters, and clear the frame
+  size_t encode(uint8_t (&out)[maxEncodedFrameSize]) {
+    auto crc = util::crc16(data, size);
+    data[size++] = crc >> 8, data[size++] = crc;
+    out[0] = 0;
+    auto n = 1 + util::cobsEncode(data, size, out + 1);
+    out[n++] = 0;
+    size = samples = 0;
+    return n;
+  }
+};
+
+static struct {
+  std::atomic<const EEPROMConfig *> config{nullptr};
+  TaskHandle_t task = nullptr;
+} streaming;
+
+static Stats stats;
+
+// the serial mutex is held only for the write of an already encoded frame
+static void flush(Frame &frame) {
+  if (!frame.count()) return;
+  uint8_t encoded[maxEncodedFrameSize];
+  stats.samples += frame.count(), stats.frames++;
+  auto size = frame.encode(encoded);
+  MSerial()->write(encoded, size);
+}
+
+static void streamLoop() [[noreturn]] {
+  // while the continuous acquisition is not running, check again every stallMillis
+  constexpr const uint32_t stallMillis = 500;
+  static Frame frame;
+  while (true) {
+    const EEPROMConfig *config;
+    while (!(config = streaming.config)) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    TickType_t frameStart = 0;
+    for (auto cursor = sampleCursor(); streaming.config == config;) {
+      auto expected = cursor;
+      Sample sample;
+      if (!nextSample(*config, cursor, sample, pdMS_TO_TICKS(flushMillis))) {
+        flush(frame);
+        if (!config->continuous) {
+          ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(stallMillis));
+          cursor = sampleCursor();
+        }
+        continue;
+      }
+      auto index = cursor - 1;
+      // the cursor skips ahead if the producer lapped us
+      stats.lost += index - expected;
+      if (!frame.count()) frameStart = sample.tick;
+      if (!frame.append(index, sample)) {
+        flush(frame);
+        frameStart = sample.tick;
+        frame.append(index, sample);
+      }
+      if (frame.count() == maxFrameSamples || sample.tick - frameStart >= pdMS_TO_TICKS(flushMillis)) flush(frame);
+    }
+    flush(frame);
+  }
+}
+
+void enable(const EEPROMConfig &config, bool on) {
+  static util::StaticTask<1024> task;
+  if (!task) streaming.task = task.init(streamLoop, "Stream", configMAX_PRIORITIES - 3);
+  streaming.config = on ? &config : nullptr;
+  xTaskNotifyGive(streaming.task);
+}
+
+bool enabled() { return streaming.config; }
+
+Stats getStats() { return stats; }
+
+} // namespace stream
+
+} // namespace scale
+
+} // namespace blastic
@@ -1,6 +1,12 @@
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include "blastic.h"
 #include "Scale.h"
+#include "RingLog.h"
+#include "MedianFilter.h"
+#include "StaticTask.h"
+#include "HX711.h"
 
 namespace blastic {
 
@@ -9,33 +15,326 @@ namespace scale {
 static StaticSemaphore_t mutexBuffer;
 static SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
 
-int32_t raw(const EEPROMConfig &config, size_t medianWidth, TickType_t timeout) {
-  configASSERT(medianWidth);
-  auto startTick = xTaskGetTickCount();
-  if (!xSemaphoreTake(mutex, timeout)) return readErr;
-  auto measurementStartTick = xTaskGetTickCount();
-  const auto sck = config.clockPin, dt = config.dataPin;
-  // poweroff the controller and release the mutex
-  auto release = [sck]() {
-    digitalWrite(sck, HIGH);
-    delayMicroseconds(64);
-    configASSERT(xSemaphoreGive(mutex));
-  };
-  pinMode(sck, OUTPUT);
-  pinMode(dt, INPUT);
-  // power cycle the controller
+// HX711 datasheet "Output settling time", we cannot query the data rate so use the maximum
+constexpr const uint32_t outputSettlingTime = 400;
+
+/*
+  Snapshot of the pins and read mode from an EEPROMConfig, the continuous acquisition restarts when it changes.
+*/
+struct Wiring {
+  uint8_t sck, channels, dts[maxChannels];
+  HX711Mode mode;
+  bool timerReadout, autoRange;
+
+  explicit Wiring(const EEPROMConfig &config)
+      : sck(config.clockPin), channels(std::clamp<uint8_t>(config.channels, 1, maxChannels)), dts{}, mode(config.mode),
+        timerReadout(config.timerReadout), autoRange(autoRanging(config)) {
+    for (uint8_t c = 0; c < channels; c++) dts[c] = config.dataChannels[c].dataPin;
+  }
+  bool operator==(const Wiring &o) const { return !memcmp(this, &o, sizeof(Wiring)); }
+  bool operator!=(const Wiring &o) const { return !(*this == o); }
+
+  // data is ready when all the controllers have pulled their data pin low
+  bool ready() const {
+    for (uint8_t c = 0; c < channels; c++)
+      if (digitalRead(dts[c]) == HIGH) return false;
+    return true;
+  }
+};
+
+static void powerCycle(const Wiring &wiring) {
+  pinMode(wiring.sck, OUTPUT);
+  for (uint8_t c = 0; c < wiring.channels; c++) pinMode(wiring.dts[c], INPUT);
+  digitalWrite(wiring.sck, HIGH);
+  delayMicroseconds(64);
+  digitalWrite(wiring.sck, LOW);
+}
+
+static void powerOff(uint8_t sck) {
   digitalWrite(sck, HIGH);
   delayMicroseconds(64);
-  digitalWrite(sck, LOW);
-  // HX711 datasheet "Output settling time", we cannot query the data rate so use the maximum
-  constexpr const uint32_t outputSettlingTime = 400;
+}
+
+// the DWT cycle counter is used to measure the critical section length
+[[maybe_unused]] static const bool cycleCounterEnabled = [] {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  return true;
+}();
+
+static CriticalSectionStats fixedPinsStats, runtimePinsStats;
+
+template <typename ClockBits> static void criticalRead(CriticalSectionStats &stats, ClockBits clockBits) {
+  taskENTER_CRITICAL();
+  auto startCycles = DWT->CYCCNT;
+  clockBits();
+  auto cycles = DWT->CYCCNT - startCycles;
+  taskEXIT_CRITICAL();
+  stats.last = cycles, stats.max = max(stats.max, cycles), stats.count++;
+}
+
+/*
+  Clock out a conversion from all the channels, the data pins must be already low (data ready). The number of pulses
+  also selects the mode of the next conversion. With timerReadout the pulses are generated by the timer interrupt,
+  falling back to bit banging if there is no free timer. A single channel on the default pins uses the unrolled,
+  compile time specialized driver, anything else falls back to the runtime pin driver. Returns false if the timer
+  frame failed.
+*/
+static bool shiftIn(const Wiring &wiring, HX711Mode nextMode, int32_t (&values)[maxChannels]) {
+  uint32_t bits[maxChannels];
+  const uint8_t pulses = 25 + uint8_t(nextMode);
+  if (wiring.timerReadout && hx711::timerAvailable()) {
+    if (!hx711::timerClockBits(wiring.sck, wiring.dts, wiring.channels, pulses, bits)) return false;
+  } else {
+    delayMicroseconds(1); // HX711 datasheet T1
+    const auto sck = wiring.sck, dt = wiring.dts[0];
+    if (wiring.channels == 1 && sck == defaultClockPin && dt == defaultDataPin && hx711::boardPinMatches(sck) &&
+        hx711::boardPinMatches(dt)) {
+      constexpr const hx711::BoardPin<defaultClockPin> fixedSck{};
+      constexpr const hx711::BoardPin<defaultDataPin> fixedDt{};
+      switch (nextMode) {
+      case HX711Mode::A128:
+        criticalRead(fixedPinsStats, [&] { bits[0] = hx711::clockBits<25>(fixedSck, fixedDt); });
+        break;
+      case HX711Mode::B:
+        criticalRead(fixedPinsStats, [&] { bits[0] = hx711::clockBits<26>(fixedSck, fixedDt); });
+        break;
+      default: criticalRead(fixedPinsStats, [&] { bits[0] = hx711::clockBits<27>(fixedSck, fixedDt); });
+      }
+    } else {
+      const hx711::RuntimePin runtimeSck(sck);
+      hx711::RuntimePin runtimeDts[maxChannels];
+      for (uint8_t c = 0; c < wiring.channels; c++) runtimeDts[c] = hx711::RuntimePin(wiring.dts[c]);
+      criticalRead(runtimePinsStats,
+                   [&] { hx711::clockBits(runtimeSck, runtimeDts, wiring.channels, pulses, bits); });
+    }
+  }
+  // sign extend
+  for (uint8_t c = 0; c < wiring.channels; c++) values[c] = bits[c] & 0x800000 ? bits[c] | 0xff000000 : bits[c];
+  return true;
+}
+
+// combine the channels with their trim in 16.16 fixed point, a float sum would lose the low bits of the reads
+static int32_t combine(const EEPROMConfig &config, uint8_t channels, const int32_t (&values)[maxChannels]) {
+  if (channels == 1 && config.dataChannels[0].trim == 1) return values[0];
+  int64_t sum = 0;
+  for (uint8_t c = 0; c < channels; c++) sum += int64_t(values[c]) * lroundf(config.dataChannels[c].trim * 65536);
+  return int32_t(std::clamp<int64_t>(sum / 65536, rawMin, rawMax));
+}
+
+// any channel at the end of the 24 bit range
+static bool saturated(const Sample &sample) {
+  for (uint8_t c = 0; c < sample.channels; c++)
+    if (sample.channelValues[c] >= 0x7fffff || sample.channelValues[c] <= -0x800000) return true;
+  return false;
+}
+
+/*
+  Auto ranging thresholds on the largest channel read. A read close to saturation in A128 switches to A64, and an A64
+  read that would be well within range in A128 (A64 has about half the gain) switches back.
+*/
+constexpr const int32_t rangeUpRead = 0x7fffff / 16 * 15, rangeDownRead = 0x7fffff / 8 * 3;
+
+static HX711Mode range(const Sample &sample) {
+  int32_t peak = 0;
+  for (uint8_t c = 0; c < sample.channels; c++) peak = max(peak, abs(sample.channelValues[c]));
+  if (sample.mode == HX711Mode::A128) return peak >= rangeUpRead ? HX711Mode::A64 : HX711Mode::A128;
+  return peak < rangeDownRead ? HX711Mode::A128 : HX711Mode::A64;
+}
+
+/*
+  The readout pulses select the mode of the following conversion, so each sample is tagged with the mode selected by
+  the previous readout (A128 after power up). Samples in a mode that is not wanted are simply skipped by the readers,
+  instead of discarding conversions. With auto ranging the next mode is chosen from the sample just read: a range
+  switch does not stall the sample stream, as the conversion in flight is still valid in its own mode.
+*/
+struct ModeSequence {
+  HX711Mode current = HX711Mode::A128, next;
+
+  explicit ModeSequence(const Wiring &wiring) : next(wiring.autoRange ? HX711Mode::A128 : wiring.mode) {}
+
+  bool read(const EEPROMConfig &config, const Wiring &wiring, Sample &sample) {
+    if (!shiftIn(wiring, next, sample.channelValues)) return false;
+    sample.tick = xTaskGetTickCount(), sample.mode = current, sample.channels = wiring.channels;
+    sample.value = combine(config, wiring.channels, sample.channelValues);
+    current = next;
+    if (wiring.autoRange) {
+      next = range(sample);
+      if (debug && next != current) {
+        MSerial serial;
+        serial->print("scale: auto ranging to ");
+        serial->println(modeStrings[uint8_t(next)]);
+      }
+    }
+    return true;
+  }
+};
+
+CriticalSectionStats criticalSectionStats(bool fixedPins) { return fixedPins ? fixedPinsStats : runtimePinsStats; }
+
+/*
+  Continuous acquisition state. The task holds the mutex above while it is running, so one-shot reads in raw() cannot
+  interfere with it. The samples are broadcast through a lock-free ring, see RingLog.h.
+*/
+
+static util::RingLog<Sample, 64> samples;
+static StaticEventGroup_t samplesEventsBuffer;
+static EventGroupHandle_t samplesEvents = xEventGroupCreateStatic(&samplesEventsBuffer);
+constexpr const EventBits_t newSampleBit = 1;
+
+static struct {
+  std::atomic<const EEPROMConfig *> config{nullptr};
+  TaskHandle_t task = nullptr;
+} acquisition;
+
+// ticks to wait between data pin checks when there is no interrupt, or as a safety net if the interrupt never fires
+static TickType_t dataPollTicks(bool irq) { return max(pdMS_TO_TICKS((irq ? 2 : 1) * minReadDelayMillis), 1); }
+
+/*
+  digitalPinToInterrupt() is the identity on this core, and attachInterrupt() returns silently on a pin without an
+  external IRQ channel: check the pin configuration table as attachInterrupt() does.
+*/
+static bool hasIrq(uint8_t pin) { return getPinCfgs(pin, PIN_CFG_REQ_INTERRUPT)[0]; }
+
+static void dataReadyISR() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(acquisition.task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void acquisitionLoop() [[noreturn]] {
+  constexpr const uint32_t dataReadyTimeout = 1000;
+  while (true) {
+    while (!acquisition.config) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+    // (re)initialize the controllers, until the task is stopped
+    for (const EEPROMConfig *config; (config = acquisition.config);) {
+      const Wiring wiring(*config);
+      // any data pin falling edge wakes up the task, the wait below checks all the pins anyway
+      int irqs[maxChannels];
+      bool allIrqs = true;
+      powerCycle(wiring);
+      for (uint8_t c = 0; c < wiring.channels; c++) {
+        irqs[c] = hasIrq(wiring.dts[c]) ? digitalPinToInterrupt(wiring.dts[c]) : -1;
+        if (irqs[c] >= 0) attachInterrupt(irqs[c], dataReadyISR, FALLING);
+        else allIrqs = false;
+      }
+      vTaskDelay(pdMS_TO_TICKS(outputSettlingTime));
+      for (ModeSequence modes(wiring); acquisition.config == config && Wiring(*config) == wiring;) {
+        // wait for data ready, spurious notifications are fine as we check the pin levels
+        auto waitStart = xTaskGetTickCount();
+        while (!wiring.ready() && xTaskGetTickCount() - waitStart < pdMS_TO_TICKS(dataReadyTimeout))
+          ulTaskNotifyTake(pdTRUE, dataPollTicks(allIrqs));
+        if (!wiring.ready()) {
+          if (debug) MSerial()->print("scale: timed out waiting for data, restarting continuous acquisition\n");
+          break;
+        }
+        Sample sample;
+        if (!modes.read(*config, wiring, sample)) {
+          if (debug) MSerial()->print("scale: readout failed, restarting continuous acquisition\n");
+          break;
+        }
+        samples.push(sample);
+        // wake up all the readers
+        xEventGroupSetBits(samplesEvents, newSampleBit);
+        xEventGroupClearBits(samplesEvents, newSampleBit);
+      }
+      for (uint8_t c = 0; c < wiring.channels; c++)
+        if (irqs[c] >= 0) detachInterrupt(irqs[c]);
+      powerOff(wiring.sck);
+    }
+    configASSERT(xSemaphoreGive(mutex));
+  }
+}
+
+// serializes the start and stop of the acquisition task, so that the subscriber count and the config stay consistent
+static StaticSemaphore_t controlMutexBuffer;
+static SemaphoreHandle_t controlMutex = xSemaphoreCreateMutexStatic(&controlMutexBuffer);
+static uint32_t subscribers = 0;
+
+static void updateAcquisition(const EEPROMConfig &config, int subscribe) {
+  static util::StaticTask<1024> task;
+  configASSERT(xSemaphoreTake(controlMutex, portMAX_DELAY));
+  if (!task) acquisition.task = task.init(acquisitionLoop, "HX711", configMAX_PRIORITIES - 2);
+  subscribers += subscribe;
+  acquisition.config = config.continuous || subscribers ? &config : nullptr;
+  xTaskNotifyGive(acquisition.task);
+  configASSERT(xSemaphoreGive(controlMutex));
+}
+
+void continuous(const EEPROMConfig &config) { updateAcquisition(config, 0); }
+
+Subscription::Subscription(const EEPROMConfig &config) : config(config) { updateAcquisition(config, 1); }
+
+Subscription::~Subscription() { updateAcquisition(config, -1); }
+
+/*
+  The read functions below pass each sample to onSample(), until it returns true. Ranged reads take the samples of
+  both the auto ranging modes, otherwise only the samples in the configured mode are used.
+*/
+
+static bool accepted(const EEPROMConfig &config, bool ranged, HX711Mode mode) {
+  return ranged ? mode != HX711Mode::B : mode == config.mode;
+}
+
+uint32_t sampleCursor(bool latest) {
+  auto count = samples.count();
+  return latest && count ? count - 1 : count;
+}
+
+bool nextSample(const EEPROMConfig &config, uint32_t &cursor, Sample &sample, TickType_t timeout) {
+  for (auto startTick = xTaskGetTickCount(); acquisition.config == &config;) {
+    if (cursor != samples.count()) {
+      if (samples.read(cursor, sample)) {
+        cursor++;
+        return true;
+      }
+      // we have been lapped by the producer, skip to the oldest sample available
+      cursor = samples.tail();
+      continue;
+    }
+    auto elapsed = xTaskGetTickCount() - startTick;
+    if (timeout != portMAX_DELAY && elapsed >= timeout) return false;
+    // a sample may be pushed before we start waiting, so do not wait longer than a poll period
+    auto wait = dataPollTicks(false);
+    if (timeout != portMAX_DELAY) wait = min(wait, timeout - elapsed);
+    xEventGroupWaitBits(samplesEvents, newSampleBit, pdFALSE, pdFALSE, wait);
+  }
+  return false;
+}
+
+template <typename OnSample>
+static bool bufferedReads(const EEPROMConfig &config, bool ranged, TickType_t startTick, TickType_t timeout,
+                          OnSample onSample) {
+  for (auto cursor = sampleCursor();;) {
+    auto elapsed = xTaskGetTickCount() - startTick;
+    Sample sample;
+    if (!nextSample(config, cursor, sample,
+                    timeout == portMAX_DELAY ? portMAX_DELAY : timeout - min(elapsed, timeout))) {
+      if (debug && acquisition.config == &config) MSerial()->print("scale: timed out waiting for buffered data\n");
+      return false;
+    }
+    if (accepted(config, ranged, sample.mode) && onSample(sample)) return true;
+  }
+}
+
+template <typename OnSample>
+static bool oneShotReads(const EEPROMConfig &config, bool ranged, TickType_t startTick, TickType_t timeout,
+                         OnSample onSample) {
+  if (!xSemaphoreTake(mutex, timeout)) return false;
+  Wiring wiring(config);
+  wiring.autoRange = wiring.autoRange && ranged;
+  // poweroff the controllers and release the mutex
+  auto release = [&wiring]() {
+    powerOff(wiring.sck);
+    configASSERT(xSemaphoreGive(mutex));
+  };
+  powerCycle(wiring);
   vTaskDelay(pdMS_TO_TICKS(outputSettlingTime));
 
-  int32_t reads[medianWidth];
-  // read #medianWidth values. Read and discard one extra value first if we need to set the chan A gain mode to 64
-  for (int i = config.mode != HX711Mode::A128 ? -1 : 0; i < medianWidth; i++) {
+  for (ModeSequence modes(wiring);;) {
     // wait for data ready
-    while (digitalRead(dt) == HIGH) {
+    while (!wiring.ready()) {
       if (timeout == portMAX_DELAY || xTaskGetTickCount() - startTick < timeout) {
         auto tickDelay = pdMS_TO_TICKS(minReadDelayMillis);
         if (tickDelay) vTaskDelay(tickDelay);
@@ -44,54 +343,298 @@ int32_t raw(const EEPROMConfig &config, size_t medianWidth, TickType_t timeout)
       }
       // timed out
       release();
-      if (debug) {
-        MSerial serial;
-        serial->print("scale: timed out waiting for data, median index ");
-        serial->println(i);
-      }
-      return readErr;
+      if (debug) MSerial()->print("scale: timed out waiting for data\n");
+      return false;
     }
-    delayMicroseconds(1); // HX711 datasheet T1
-    // drive sck pin to receive data from dt pin
-    taskENTER_CRITICAL();
-    int32_t value = 0;
-    for (auto i = 25 + uint8_t(config.mode), mask = 0x800000; i; i--, mask >>= 1) {
-      digitalWrite(sck, HIGH);
-      delayMicroseconds(1); // HX711 datasheet T3
-      if (digitalRead(dt) == HIGH) value |= mask;
-      digitalWrite(sck, LOW);
-      delayMicroseconds(1); // HX711 datasheet T4
+    Sample sample;
+    if (!modes.read(config, wiring, sample)) {
+      release();
+      if (debug) MSerial()->print("scale: readout failed\n");
+      return false;
     }
-    taskEXIT_CRITICAL();
-    if (i < 0) continue;
-    // sign extend
-    if (value & 0x800000) value |= 0xff000000;
-    reads[i] = value;
+    if (accepted(config, ranged, sample.mode) && onSample(sample)) break;
   }
   release();
+  return true;
+}
+
+template <typename OnSample>
+static bool reads(const EEPROMConfig &config, bool ranged, TickType_t timeout, OnSample onSample) {
+  auto startTick = xTaskGetTickCount();
+  return acquisition.config == &config ? bufferedReads(config, ranged, startTick, timeout, onSample)
+                                       : oneShotReads(config, ranged, startTick, timeout, onSample);
+}
+
+using RawFilter = MedianFilter<int32_t, maxMedianWidth>;
+
+// weight change per raw count around raw, from the calibration of mode (NAN if uncalibrated)
+static float weightPerCount(const EEPROMConfig &config, int32_t raw, HX711Mode mode) {
+  constexpr const int32_t step = 256;
+  return fabsf(float(weight(config, raw + step, mode)) - float(weight(config, raw, mode))) / step;
+}
+
+static std::atomic<float> lastNoise{NAN};
+
+/*
+  Median of medianWidth samples or, with medianWidth == adaptiveMedian, of as many samples as needed for the standard
+  error of the median to reach config.adaptive.resolution. The noise is estimated with a running variance (Welford),
+  and the resolution is converted to raw counts with the local slope of the calibration.
+*/
+class Collector {
+  const EEPROMConfig &config;
+  RawFilter filter;
+  const bool adaptive;
+  size_t width;
+  uint32_t n;
+  double mean, m2;
+
+public:
+  HX711Mode mode;
+
+  Collector(const EEPROMConfig &config, size_t medianWidth, HX711Mode mode)
+      : config(config), adaptive(medianWidth == adaptiveMedian),
+        width(adaptive ? std::clamp<size_t>(config.adaptive.maxSamples, 1, maxMedianWidth) : medianWidth) {
+    reset(mode);
+  }
+
+  void reset(HX711Mode mode) {
+    filter.reset(width);
+    n = 0, mean = m2 = 0, this->mode = mode;
+  }
+
+  // returns true when enough samples have been collected
+  bool push(int32_t value) {
+    filter.push(value);
+    n++;
+    auto delta = value - mean;
+    mean += delta / n;
+    m2 += delta * (value - mean);
+    if (filter.full()) return true;
+    if (!adaptive || n < max<uint32_t>(config.adaptive.minSamples, 2)) return false;
+    return standardError() <= config.adaptive.resolution / weightPerCount(config, filter.median(), mode);
+  }
+
+  // an adaptive acquisition cut short, e.g. by the timeout, is still usable with at least minSamples samples
+  bool partial() const { return adaptive && n && n >= config.adaptive.minSamples; }
+  const RawFilter &samples() const { return filter; }
+  int32_t median() const { return filter.median(); }
+  float noise() const { return n >= 2 ? sqrt(m2 / (n - 1)) : NAN; }
+  // the median of normally distributed samples has about 1.25 times the standard error of the mean
+  float standardError() const { return 1.2533f * noise() / sqrtf(n); }
+
+  void recordNoise() const {
+    if (n >= 2) lastNoise = noise();
+    if (debug && adaptive) {
+      MSerial serial;
+      serial->print("scale: adaptive acquisition samples ");
+      serial->print(n);
+      serial->print(" noise ");
+      serial->println(noise(), 1);
+    }
+  }
+};
+
+float noise() { return lastNoise; }
+
+/*
+  Single-flight coalescing of one-shot reads. A one-shot read holds the mutex for a power cycle, the settling time and
+  all its conversions, so concurrent callers used to queue and then pay the same again. Now a caller that finds a read
+  in flight with the same config, mode and median width waits for that read and returns its result. A caller with
+  different parameters runs its own read as before, serialized on the mutex, but does not lead a flight. The timeout
+  is not part of the key, so the leader only hands over complete results: if the flight fails, or returns the partial
+  median of an adaptive read cut short by the leader's timeout, the waiting callers fall back to their own read with
+  the time they have left.
+*/
+template <typename Result> class SingleFlight {
+public:
+  struct Key {
+    const EEPROMConfig *config;
+    size_t medianWidth;
+    HX711Mode mode;
+    bool operator==(const Key &o) const { return config == o.config && medianWidth == o.medianWidth && mode == o.mode; }
+  };
+
+private:
+  StaticSemaphore_t mutexBuffer;
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+  StaticEventGroup_t eventsBuffer;
+  EventGroupHandle_t events = xEventGroupCreateStatic(&eventsBuffer);
+  static constexpr const EventBits_t landedBit = 1;
+  Key key;
+  bool inFlight = false;
+  // number of completed flights, and the result of the last one
+  uint32_t landed = 0;
+  Result result;
+  bool complete = false;
+
+public:
+  /*
+    Return read(timeout, complete), or the complete result of a compatible read in flight, or failed on timeout
+    waiting for it. read sets complete to false when its result is only good for its own caller.
+  */
+  template <typename Read> Result run(const Key &k, TickType_t timeout, Result failed, Read read) {
+    auto startTick = xTaskGetTickCount();
+    configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+    if (!inFlight || !(key == k)) {
+      bool lead = !inFlight;
+      if (lead) key = k, inFlight = true;
+      configASSERT(xSemaphoreGive(mutex));
+      bool c;
+      auto r = read(timeout, c);
+      if (!lead) return r;
+      configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+      result = r, complete = c && !(r == failed), landed++, inFlight = false;
+      configASSERT(xSemaphoreGive(mutex));
+      // wake up all the passengers
+      xEventGroupSetBits(events, landedBit);
+      xEventGroupClearBits(events, landedBit);
+      return r;
+    }
+    auto flight = landed;
+    configASSERT(xSemaphoreGive(mutex));
+    if (debug >= 2) MSerial()->print("scale: attached to the read in flight\n");
+    while (true) {
+      configASSERT(xSemaphoreTake(mutex, portMAX_DELAY));
+      bool done = landed != flight, c = complete;
+      auto r = result;
+      configASSERT(xSemaphoreGive(mutex));
+      auto elapsed = xTaskGetTickCount() - startTick;
+      if (done && c) return r;
+      if (timeout != portMAX_DELAY && elapsed >= timeout) return failed;
+      if (done) {
+        if (debug >= 2) MSerial()->print("scale: the read in flight failed or was partial, reading again\n");
+        return read(timeout == portMAX_DELAY ? portMAX_DELAY : timeout - elapsed, c);
+      }
+      // the flight may land before we start waiting, so do not wait longer than a poll period
+      auto wait = dataPollTicks(false);
+      if (timeout != portMAX_DELAY) wait = min(wait, timeout - elapsed);
+      xEventGroupWaitBits(events, landedBit, pdFALSE, pdFALSE, wait);
+    }
+  }
+};
+
+static SingleFlight<int32_t> rawFlight;
+static SingleFlight<util::AnnotatedFloat> weightFlight;
+
+// complete is false when the result is the partial median of an adaptive read that timed out
+static int32_t singleRaw(const EEPROMConfig &config, size_t medianWidth, TickType_t timeout, bool &complete) {
+  auto startTick = xTaskGetTickCount();
+  Collector collector(config, medianWidth, config.mode);
+  complete = reads(config, false, timeout, [&](const Sample &sample) { return collector.push(sample.value); });
+  if (!complete && !collector.partial()) return readErr;
+  collector.recordNoise();
   if (debug >= 2) {
     auto endTick = xTaskGetTickCount();
+    auto &filter = collector.samples();
     MSerial serial;
     serial->print("scale::rawMedian:");
-    for (auto read = reads; read < reads + medianWidth; read++) {
+    for (size_t i = 0; i < filter.count(); i++) {
       serial->print(' ');
-      serial->print(*read);
+      serial->print(filter[i]);
     }
     serial->print(" elapsed ");
-    serial->println(portTICK_PERIOD_MS * (endTick - measurementStartTick));
+    serial->println(portTICK_PERIOD_MS * (endTick - startTick));
+  }
+  return collector.median();
+}
+
+int32_t raw(const EEPROMConfig &config, size_t medianWidth, TickType_t timeout) {
+  // buffered reads do not contend for the controller, nothing to coalesce
+  if (acquisition.config == &config) {
+    bool complete;
+    return singleRaw(config, medianWidth, timeout, complete);
+  }
+  return rawFlight.run({&config, medianWidth, config.mode}, timeout, readErr, [&](TickType_t left, bool &complete) {
+    return singleRaw(config, medianWidth, left, complete);
+  });
+}
+
+bool rawChannels(const EEPROMConfig &config, int32_t &combined, int32_t (&channels)[maxChannels], size_t medianWidth,
+                 TickType_t timeout) {
+  Collector collector(config, medianWidth, config.mode);
+  RawFilter channelFilters[maxChannels];
+  uint8_t sampleChannels = 0;
+  bool complete = reads(config, false, timeout, [&](const Sample &sample) {
+    sampleChannels = sample.channels;
+    for (uint8_t c = 0; c < sample.channels; c++) channelFilters[c].push(sample.channelValues[c]);
+    return collector.push(sample.value);
+  });
+  if (!complete && !collector.partial()) return false;
+  collector.recordNoise();
+  combined = collector.median();
+  for (uint8_t c = 0; c < maxChannels; c++) channels[c] = c < sampleChannels ? channelFilters[c].median() : 0;
+  return true;
+}
+
+void channelWeights(const EEPROMConfig &config, const int32_t (&channels)[maxChannels], float weight,
+                    float (&weights)[maxChannels]) {
+  auto &calibration = config.getCalibration();
+  float loads[maxChannels], total = 0;
+  for (size_t c = 0; c < maxChannels; c++) {
+    loads[c] = c < config.channels
+                   ? config.dataChannels[c].trim * float(channels[c] - calibration.channelTareRawReads[c])
+                   : 0;
+    total += loads[c];
   }
-  std::sort(reads, reads + medianWidth);
-  if (medianWidth % 2) return reads[medianWidth / 2];
-  return (reads[medianWidth / 2 - 1] + reads[medianWidth / 2]) / 2;
+  for (size_t c = 0; c < maxChannels; c++) weights[c] = total ? weight * loads[c] / total : 0;
+}
+
+bool autoRanging(const EEPROMConfig &config) {
+  return config.autoRange && config.mode != HX711Mode::B && config.calibrations[uint8_t(HX711Mode::A128)] &&
+         config.calibrations[uint8_t(HX711Mode::A64)];
+}
+
+// complete as in singleRaw()
+static util::AnnotatedFloat singleWeight(const EEPROMConfig &config, size_t medianWidth, TickType_t timeout,
+                                         bool &complete) {
+  // the median is taken on samples in the same mode, start again if the range changes
+  Collector collector(config, medianWidth, config.mode);
+  size_t saturatedCount = 0;
+  complete = reads(config, autoRanging(config), timeout, [&](const Sample &sample) {
+    if (sample.mode != collector.mode) collector.reset(sample.mode), saturatedCount = 0;
+    saturatedCount += saturated(sample);
+    return collector.push(sample.value);
+  });
+  if (!complete && !collector.partial()) return weightErr;
+  collector.recordNoise();
+  if (2 * saturatedCount > collector.samples().count()) return weightSat;
+  return weight(config, collector.median(), collector.mode);
 }
 
 util::AnnotatedFloat weight(const EEPROMConfig &config, size_t medianWidth, TickType_t timeout) {
-  auto calibration = config.getCalibration();
-  if (!calibration) return weightCal;
-  auto value = raw(config, medianWidth, timeout);
-  if (value == readErr) return weightErr;
-  return util::AnnotatedFloat(calibration.weight * float(value - calibration.tareRawRead) /
-                              float(calibration.weightRawRead - calibration.tareRawRead));
+  if (!config.getCalibration()) return weightCal;
+  if (acquisition.config == &config) {
+    bool complete;
+    return singleWeight(config, medianWidth, timeout, complete);
+  }
+  return weightFlight.run({&config, medianWidth, config.mode}, timeout, weightErr,
+                          [&](TickType_t left, bool &complete) {
+                            return singleWeight(config, medianWidth, left, complete);
+                          });
+}
+
+util::AnnotatedFloat bufferedWeight(const EEPROMConfig &config, TickType_t from, TickType_t to, size_t minSamples) {
+  if (!config.getCalibration()) return weightCal;
+  bool ranged = autoRanging(config);
+  RawFilter filter;
+  HX711Mode mode;
+  size_t saturatedCount = 0;
+  // walk back from the newest sample, until the start of the window or a sample that has been overwritten
+  for (auto i = sampleCursor(); i-- && !filter.full();) {
+    Sample sample;
+    if (!samples.read(i, sample)) break;
+    TickType_t age = to - sample.tick;
+    if (int32_t(age) < 0) continue;
+    if (age > to - from) break;
+    if (!accepted(config, ranged, sample.mode)) continue;
+    if (!filter.count()) mode = sample.mode;
+    else if (sample.mode != mode) break;
+    filter.push(sample.value);
+    saturatedCount += saturated(sample);
+  }
+  if (filter.count() < max<size_t>(minSamples, 1)) return weightErr;
+  if (2 * saturatedCount > filter.count()) return weightSat;
+  return weight(config, filter.median(), mode);
 }
 
 } // namespace scale
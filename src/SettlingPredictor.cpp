@@ -0,0 +1,75 @@
+#include <cmath>
+#include "SettlingPredictor.h"
+
+namespace blastic {
+
+namespace scale {
+
+void SettlingPredictor::reset() {
+  size = next = 0;
+  isConfident = false;
+  lastUncertainty = INFINITY;
+}
+
+bool SettlingPredictor::update(const EEPROMConfig &config, float weight, TickType_t tick) {
+  if (std::isnan(weight) || (size && tick - lastTick > pdMS_TO_TICKS(maxGapMillis))) reset();
+  lastTick = tick;
+  if (std::isnan(weight)) return false;
+  auto window = config.window < minWindow ? minWindow : config.window > capacity ? capacity : config.window;
+  while (size >= window) size--;
+  weights[next] = weight;
+  next = (next + 1) % capacity, size++;
+  isConfident = size == window && fit() && lastUncertainty <= config.maxUncertainty;
+  return isConfident;
+}
+
+bool SettlingPredictor::fit() {
+  // center the values on the newest sample to keep the float sums small
+  const float ref = at(size - 1);
+  // normal equations for the regressors x = (y[n-1], y[n-2], 1)
+  float xx[3][3] = {}, xy[3] = {};
+  const size_t rows = size - 2;
+  for (size_t n = 2; n < size; n++) {
+    const float x[3] = {at(n - 1) - ref, at(n - 2) - ref, 1}, y = at(n) - ref;
+    for (int i = 0; i < 3; i++) {
+      xy[i] += x[i] * y;
+      for (int j = 0; j < 3; j++) xx[i][j] += x[i] * x[j];
+    }
+  }
+  // invert the 3x3 symmetric matrix via the adjugate
+  float inv[3][3];
+  inv[0][0] = xx[1][1] * xx[2][2] - xx[1][2] * xx[2][1];
+  inv[0][1] = xx[0][2] * xx[2][1] - xx[0][1] * xx[2][2];
+  inv[0][2] = xx[0][1] * xx[1][2] - xx[0][2] * xx[1][1];
+  inv[1][1] = xx[0][0] * xx[2][2] - xx[0][2] * xx[2][0];
+  inv[1][2] = xx[0][2] * xx[1][0] - xx[0][0] * xx[1][2];
+  inv[2][2] = xx[0][0] * xx[1][1] - xx[0][1] * xx[1][0];
+  auto det = xx[0][0] * inv[0][0] + xx[0][1] * inv[0][1] + xx[0][2] * inv[0][2];
+  if (!(fabsf(det) > 1e-20f)) return false;
+  inv[1][0] = inv[0][1], inv[2][0] = inv[0][2], inv[2][1] = inv[1][2];
+  for (auto &row : inv)
+    for (auto &v : row) v /= det;
+  float beta[3];
+  for (int i = 0; i < 3; i++) beta[i] = inv[i][0] * xy[0] + inv[i][1] * xy[1] + inv[i][2] * xy[2];
+  const float a1 = beta[0], a2 = beta[1], c = beta[2];
+  // the model must be stable (poles inside the unit circle) to converge to a final value
+  if (!(fabsf(a2) < 1 && a1 + a2 < 1 && a2 - a1 < 1)) return false;
+  float sse = 0;
+  for (size_t n = 2; n < size; n++) {
+    auto residual = (at(n) - ref) - (a1 * (at(n - 1) - ref) + a2 * (at(n - 2) - ref) + c);
+    sse += residual * residual;
+  }
+  const float gain = 1 / (1 - a1 - a2), variance = sse / (rows - 3);
+  lastPrediction = ref + c * gain;
+  // delta method: gradient of c / (1 - a1 - a2) with respect to (a1, a2, c)
+  const float grad[3] = {c * gain * gain, c * gain * gain, gain};
+  float predictionVariance = 0;
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) predictionVariance += grad[i] * inv[i][j] * grad[j];
+  lastUncertainty = sqrtf(variance * predictionVariance);
+  return std::isfinite(lastUncertainty);
+}
+
+} // namespace scale
+
+} // namespace blastic
@@ -0,0 +1,62 @@
+#include <cmath>
+#include "StabilityDetector.h"
+
+namespace blastic {
+
+namespace scale {
+
+void StabilityDetector::reset() {
+  size = next = 0;
+  isSettled = false;
+  lastDeviation = lastSlope = 0;
+}
+
+StabilityDetector::Event StabilityDetector::update(const EEPROMConfig &config, float weight, TickType_t tick) {
+  if (std::isnan(weight)) {
+    auto wasSettled = isSettled;
+    reset();
+    return wasSettled ? Event::UNSETTLED : Event::NONE;
+  }
+  const TickType_t window = pdMS_TO_TICKS(config.windowMillis);
+  if (size && tick - ticks[index(size - 1)] < window / capacity) return Event::NONE;
+  if (size == capacity) size--;
+  weights[next] = weight, ticks[next] = tick;
+  next = (next + 1) % capacity, size++;
+  // drop samples as long as the remaining ones still span the window
+  while (size > 2 && tick - ticks[index(1)] >= window) size--;
+  if (size < 3 || tick - ticks[index(0)] < window) return Event::NONE;
+
+  // statistics relative to the newest sample, in seconds, to keep the float sums small
+  float meanT = 0, meanW = 0;
+  for (size_t i = 0; i < size; i++) {
+    meanT += float(int32_t(ticks[index(i)] - tick) * portTICK_PERIOD_MS) / 1000;
+    meanW += weights[index(i)];
+  }
+  meanT /= size, meanW /= size;
+  float varT = 0, varW = 0, covTW = 0;
+  for (size_t i = 0; i < size; i++) {
+    auto dt = float(int32_t(ticks[index(i)] - tick) * portTICK_PERIOD_MS) / 1000 - meanT,
+         dw = weights[index(i)] - meanW;
+    varT += dt * dt, varW += dw * dw, covTW += dt * dw;
+  }
+  lastDeviation = sqrtf(varW / size);
+  lastSlope = varT > 0 ? covTW / varT : 0;
+
+  auto absSlope = fabsf(lastSlope);
+  if (!isSettled) {
+    if (lastDeviation > config.maxDeviation || absSlope > config.maxSlope) return Event::NONE;
+    isSettled = true;
+    settledValue = meanW;
+    return Event::SETTLED;
+  }
+  if (lastDeviation > 2 * config.maxDeviation || absSlope > 2 * config.maxSlope) {
+    isSettled = false;
+    return Event::UNSETTLED;
+  }
+  settledValue = meanW;
+  return Event::NONE;
+}
+
+} // namespace scale
+
+} // namespace blastic
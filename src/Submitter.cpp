@@ -1,9 +1,11 @@
 #include <string>
 #include <array>
 #include "blastic.h"
+#include "History.h"
+#include "Journal.h"
+#include "Uploader.h"
 #include <ArduinoGraphics.h>
 #include <Arduino_LED_Matrix.h>
-#include <ArduinoHttpClient.h>
 #include "utils.h"
 
 namespace blastic {
@@ -70,9 +72,12 @@ static util::loopFunction scroll(std::string &&str, unsigned int initialDelay =
   example, 0.00543 is shown as "543" with 3 dots to the left.
 
   Negative numbers do not show a minus sign (-), but rather the position of the point is shown above the digits.
+
+  A marker of markerWidth leds can be drawn on the right, in the free row opposite to the decimal points. It is used
+  to show a settled weight (3 leds) or a predicted final weight (1 led).
 */
 
-static util::loopFunction show(float v) {
+static util::loopFunction show(float v, int markerWidth = 0) {
   if (isnan(v)) {
     std::string str("nan:   ");
     util::AnnotatedFloat(v).getAnnotation(str.data() + 4);
@@ -109,7 +114,8 @@ static util::loopFunction show(float v) {
   // value negative: value aligned to bottom, dots above value
   // with the 4x6 font numbers are actually 3x5, so align dots at Y offset 6
   auto textYOffset = v >= 0 ? 0 : matrixHeight - font.height,
-       dotsYOffset = v >= 0 ? textYOffset + font.height : textYOffset - 2;
+       dotsYOffset = v >= 0 ? textYOffset + font.height : textYOffset - 2,
+       markerYOffset = v >= 0 ? matrixHeight - 1 : 1;
 
   return [=](uint32_t &) {
     matrix.clear();
@@ -124,6 +130,7 @@ static util::loopFunction show(float v) {
     // powers of 10, dots on the right
     for (int i = 0; i < max(order + 1 - fullCharsOnMatrix, 0); i++)
       matrix.set(matrixWidth - 1 - i, dotsYOffset, 1, 1, 1);
+    for (int i = 0; i < markerWidth; i++) matrix.set(matrixWidth - 1 - i, markerYOffset, 1, 1, 1);
     matrix.endDraw();
     return portMAX_DELAY;
   };
@@ -136,17 +143,22 @@ static util::loopFunction show(float v) {
 void Submitter::gotInput() { lastInteractionMillis = millis(); }
 
 /*
-  Idle loop: show nothing, measure weight every 2 seconds.
+  Idle loop: show nothing, measure weight every 2 seconds. Readings are also fed to the zero tracker and the history.
 */
 
 Submitter::Action Submitter::idling() {
   painter = clear();
+  // the settled value of the last preview is stale, OK from here must take a new measurement
+  stability.reset();
   constexpr const auto idleWeightInterval = 2000;
   while (true) {
     uint32_t cmd;
     float weight;
     if (xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(idleWeightInterval))) return toAction(cmd);
     weight = scale::weight(config.scale, 1, pdMS_TO_TICKS(1000));
+    auto tick = xTaskGetTickCount();
+    scale::trackZero(config.scale, util::AnnotatedFloat(weight), tick, config.submit.threshold);
+    history::append(util::AnnotatedFloat(weight), tick);
     if (abs(weight) >= config.submit.threshold) {
       gotInput();
       return Action::NONE;
@@ -157,23 +169,43 @@ Submitter::Action Submitter::idling() {
 constexpr const auto idleTimeout = 60000;
 
 /*
-  Preview weight loop: show weight live, measure continuously, as HX711 allows.
+  Preview weight loop: show weight live, measure continuously, as HX711 allows. The weight stream is also fed to the
+  stability detector and to the settling predictor: a settled weight is marked on screen, and while the load is still
+  moving a confident prediction of the final weight is shown instead of the live value.
 */
 
 HasTimedOut<Submitter::Action> Submitter::preview() {
   auto prevWeight = util::AnnotatedFloat("n/a");
+  // sample continuously while previewing, other readers then share the samples instead of waiting for the mutex
+  scale::Subscription subscription(config.scale);
+  stability.reset();
+  predictor.reset();
   for (; millis() - lastInteractionMillis < idleTimeout;) {
     uint32_t cmd;
     if (xTaskNotifyWait(0, -1, &cmd, 0)) return toAction(cmd);
     auto weight = scale::weight(config.scale, 1, pdMS_TO_TICKS(1000));
+    auto tick = xTaskGetTickCount();
+    scale::trackZero(config.scale, weight, tick, config.submit.threshold);
+    history::append(weight, tick);
+    auto event = stability.update(config.scale.stability, weight, tick);
+    auto predicted = predictor.update(config.scale.prediction, weight, tick) && !stability.settled();
+    if (predicted) weight = util::AnnotatedFloat(predictor.prediction());
+    if (debug && event != scale::StabilityDetector::Event::NONE) {
+      MSerial serial;
+      if (event == scale::StabilityDetector::Event::SETTLED) {
+        serial->print("submitter: settled at ");
+        serial->println(stability.value(), 3);
+      } else serial->print("submitter: unsettled\n");
+    }
     if (abs(weight) < config.submit.threshold) weight.f = 0;
     else gotInput();
-    if (weight == prevWeight) continue;
+    if (weight == prevWeight && event == scale::StabilityDetector::Event::NONE) continue;
     prevWeight = weight;
     if (weight == scale::weightCal) painter = scroll("uncalibrated");
     else if (weight == scale::weightErr) painter = scroll("sensor error");
+    else if (weight == scale::weightSat) painter = scroll("overload");
     else if (weight == 0) painter = scroll("0");
-    else painter = show(weight);
+    else painter = show(weight, stability.settled() ? 3 : predicted ? 1 : 0);
   }
   return {};
 }
@@ -200,8 +232,6 @@ HasTimedOut<plastic> Submitter::plasticSelection() {
   }
 }
 
-static constexpr const char userAgent[] = "blastic-scale/" BLASTIC_GIT_COMMIT " (" BLASTIC_GIT_WORKTREE_STATUS ")";
-
 /*
   Main submitter logic and UI.
 */
@@ -220,43 +250,50 @@ void Submitter::loop() [[noreturn]] {
     auto action = preview();
     if (action.timedOut) {
       if (debug) MSerial()->print("submitter: idling\n");
+      // nobody is weighing, do not hold back the batched submissions
+      uploader::flush();
       action = idling();
+      // a load or a touch, the connections are ready by the time a type is selected
+      uploader::prewarm();
     }
     gotInput();
     if (action != Action::OK) continue;
     uint32_t cmd;
     // sanity checks for configuration
-    {
-      MWiFi wifi;
-      if (strcmp(wifi->firmwareVersion(), WIFI_FIRMWARE_LATEST_VERSION)) {
-        painter = scroll("bad wifi firmware");
-        xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(10000));
-        continue;
-      }
+    if (!WifiConnection::firmwareOk()) {
+      painter = scroll("bad wifi firmware");
+      xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(10000));
+      continue;
     }
-    auto config = blastic::config.submit;
+    const auto &config = blastic::config.submit;
     if (!strlen(config.collectionPoint)) {
       painter = scroll("missing collection point name");
       xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(10000));
       continue;
     }
-    const char *path = strchr(config.form.urn, '/');
-    decltype(config.form.urn) serverAddress;
-    if (path) strcpy0(serverAddress, config.form.urn, path - config.form.urn);
-    else {
-      strcpy0(serverAddress, config.form.urn);
-      path = "/";
-    }
-    if (!strlen(config.form.urn) || !strlen(config.form.type) || !strlen(config.form.collectionPoint) ||
-        !strlen(config.form.weight)) {
-      painter = scroll("bad form pointers");
+    if (!uploader::configured()) {
+      painter = scroll("bad upload config");
       xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(5000));
       continue;
     }
 
+    uploader::prewarm();
     if (debug) MSerial()->print("submitter: start submission\n");
-    painter = scroll("...");
-    auto weight = scale::weight(blastic::config.scale, 10);
+    auto weight = scale::weightErr;
+    if (config.captureSettled && stability.settled()) {
+      weight = util::AnnotatedFloat(stability.value());
+      if (debug) MSerial()->print("submitter: using settled weight\n");
+    } else if (config.captureWindow) {
+      // the samples before the button edge were taken before the operator could lean on the bin
+      TickType_t edgeTick = actionTick;
+      weight = scale::bufferedWeight(blastic::config.scale, edgeTick - pdMS_TO_TICKS(config.captureWindow), edgeTick);
+      if (debug && !isnan(weight)) MSerial()->print("submitter: using the weight before the button edge\n");
+    }
+    // no usable samples were buffered, take a new measurement
+    if (isnan(weight)) {
+      painter = scroll("...");
+      weight = scale::weight(blastic::config.scale, scale::adaptiveMedian, pdMS_TO_TICKS(5000));
+    }
     if (!(weight >= config.threshold)) {
       if (weight < config.threshold) painter = scroll("<=0");
       else painter = scroll("bad value");
@@ -271,96 +308,29 @@ void Submitter::loop() [[noreturn]] {
     }
     auto plastic = plasticSelection();
     if (plastic.timedOut) continue;
+    // the uploader task sends it in the background, the UI goes back to the preview
+    auto serial = journal::append(uint8_t(plastic.t), weight);
+    if (!serial) {
+      painter = scroll("queue full");
+      xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(5000));
+      continue;
+    }
+    uploader::submitted(serial);
     painter = scroll(plasticName(plastic), 200, 100, 2);
     xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(2000));
-    painter = scroll("sending form...");
-    int statusCode;
-    {
-      WifiConnection wifi(blastic::config.wifi);
-      if (!wifi) {
-        if (debug) MSerial()->print("submitter: failed to connect to wifi\n");
-        painter = scroll("wifi error");
-        xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(5000));
-        continue;
-      }
-      WiFiSSLClient tls;
-      if (!tls.connect(serverAddress, HttpClient::kHttpsPort)) {
-        MSerial()->print("submitter: failed to connect to server\n");
-        painter = scroll("tls error");
-        xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(5000));
-        return;
-      }
-
-      String formData;
-      formData += config.form.type;
-      formData += '=';
-      formData += uint8_t(plastic.t);
-      formData += '+'; // space
-      formData += plasticName(plastic);
-      formData += '&';
-      formData += config.form.collectionPoint;
-      formData += '=';
-      formData += URLEncoder.encode(config.collectionPoint);
-      formData += '&';
-      formData += config.form.weight;
-      formData += '=';
-      formData += weight;
-      formData += '&';
-      formData += config.form.collectorName;
-      formData += '=';
-      formData += URLEncoder.encode(strlen(config.collectorName) ? config.collectorName : userAgent);
-
-      HttpClient https(tls, serverAddress, HttpClient::kHttpsPort);
-      https.beginRequest();
-      https.noDefaultRequestHeaders();
-      https.connectionKeepAlive();
-      https.post(path);
-      https.sendHeader("Host", serverAddress);
-      https.sendHeader("User-Agent", userAgent);
-      https.sendHeader("Content-Type", "application/x-www-form-urlencoded");
-      https.sendHeader("Content-Length", formData.length());
-      https.sendHeader("Accept", "*/*");
-      https.beginBody();
-      https.print(formData);
-      https.endRequest();
-
-      statusCode = https.responseStatusCode();
-      if (debug) {
-        MSerial serial;
-        serial->print("submitter::response: ");
-        serial->println(statusCode);
-        while (https.headerAvailable()) {
-          serial->print("submitter::response: ");
-          serial->print(https.readHeaderName());
-          serial->print(": ");
-          serial->println(https.readHeaderValue());
-        }
-        serial->print("submitter::response: body:\n");
-        constexpr const size_t maxLen = std::min(255, SERIAL_BUFFER_SIZE - 1);
-        while (https.available()) {
-          char bodyChunk[maxLen];
-          auto len = https.readBytes(bodyChunk, maxLen);
-          serial->write(bodyChunk, len);
-        }
-        serial->println();
-      }
-    }
-    if (statusCode == 200) painter = scroll("ok!");
-    else {
-      std::string errorMsg = (statusCode >= 100 && statusCode < 600) ? "http error " : "connection error ";
-      errorMsg += statusCode;
-      painter = scroll(std::move(errorMsg));
-    }
-    xTaskNotifyWait(0, -1, &cmd, pdMS_TO_TICKS(5000));
   }
 }
 
 Submitter::Submitter(const char *name, UBaseType_t priority)
     : painter("Painter", priority), task(Submitter::loop, this, name, priority) {}
 
-void Submitter::action(Action action) { xTaskNotify(task, uint8_t(action), eSetValueWithOverwrite); }
+void Submitter::action(Action action) {
+  actionTick = xTaskGetTickCount();
+  xTaskNotify(task, uint8_t(action), eSetValueWithOverwrite);
+}
 
-void Submitter::action_ISR(Action action) {
+void Submitter::action_ISR(Action action, TickType_t edgeTick) {
+  actionTick = edgeTick;
   BaseType_t woken = pdFALSE;
   xTaskNotifyFromISR(task, uint8_t(action), eSetValueWithOverwrite, &woken);
   portYIELD_FROM_ISR(woken);
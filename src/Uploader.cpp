@@ -0,0 +1,119 @@
+#include <atomic>
+#include <iterator>
+#include "blastic.h"
+#include "Journal.h"
+#include "Uploader.h"
+#include "StaticTask.h"
+#include "utils.h"
+
+namespace blastic {
+
+namespace uploader {
+
+static constexpr const char userAgent[] = "blastic-scale/" BLASTIC_GIT_COMMIT " (" BLASTIC_GIT_WORKTREE_STATUS ")";
+
+static TaskHandle_t uploaderTask = nullptr;
+static std::atomic<bool> prewarmRequested{false};
+
+/*
+  The TLS connection of an endpoint. Used or just prewarmed, it has the lifetime of the WiFi connection: it is closed
+  right before WiFi is brought down, disconnectTimeout seconds after the last WifiConnection is released. The WiFi
+  disconnection callback runs in another task, but with the WiFi mutex held, as the uploader task when it uses the
+  connection.
+*/
+class TlsTransport : public Transport {
+  WiFiSSLClient tls;
+
+public:
+  bool connect(const char *host, uint16_t port) override { return tls.connect(host, port); }
+  bool connected() override { return tls.connected(); }
+  size_t write(const uint8_t *data, size_t size) override { return tls.write(data, size); }
+  int read(uint8_t *data, size_t size) override { return tls.read(data, size); }
+  void stop() override { tls.stop(); }
+};
+
+// the fan-out with the debug output on the serial console
+class TaskFanout : public Fanout {
+  using Fanout::Fanout;
+  bool debugging() const override { return debug; }
+  void print(const char *text, size_t length) const override { MSerial()->write(text, length); }
+};
+
+static TlsTransport tlsTransports[journal::maxEndpoints];
+static Transport *const transports[]{&tlsTransports[0], &tlsTransports[1], &tlsTransports[2]};
+static_assert(std::size(transports) == journal::maxEndpoints);
+static const Identity identity{config.submit.collectionPoint, config.submit.collectorName, userAgent};
+static TaskFanout fanout(config.submit.endpoints, identity, transports);
+
+// the WiFi connection is about to be brought down, called with the WiFi mutex held
+static void disconnectAll() { fanout.disconnectAll(); }
+
+static void warmUp() {
+  // bring up WiFi only if something can be delivered, and only if it can work
+  if (!fanout.active() || !strnlen(config.wifi.ssid, sizeof(config.wifi.ssid)) || !WifiConnection::firmwareOk())
+    return;
+  WifiConnection wifi(blastic::config.wifi);
+  if (!wifi) {
+    if (debug) MSerial()->print("uploader: prewarm failed to connect to wifi\n");
+    return;
+  }
+  fanout.warmUp();
+}
+
+// bring up WiFi only if some endpoint is due
+static void deliver(bool woken) {
+  auto wanting = fanout.due(woken);
+  if (!wanting) return;
+  WifiConnection wifi(blastic::config.wifi);
+  if (!wifi) {
+    if (debug) MSerial()->print("uploader: failed to connect to wifi\n");
+    return fanout.fail(wanting, wifiError);
+  }
+  fanout.deliver(wanting);
+}
+
+static void uploaderLoop() [[noreturn]] {
+  while (true) {
+    bool woken = ulTaskNotifyTake(pdTRUE, fanout.nextCheck());
+    // the endpoints may have been changed from the CLI
+    journal::endpoints(fanout.active());
+    if (prewarmRequested.exchange(false)) warmUp();
+    deliver(woken);
+  }
+}
+
+void start() {
+  static util::StaticTask<4 * 1024> task;
+  if (!task) {
+    WifiConnection::onDisconnect(disconnectAll);
+    uploaderTask = task.init(uploaderLoop, "Uploader", configMAX_PRIORITIES / 2 - 1);
+  }
+  wake();
+}
+
+void wake() {
+  if (uploaderTask) xTaskNotifyGive(uploaderTask);
+}
+
+void submitted(uint32_t serial) {
+  fanout.submitted(serial, xTaskGetTickCount());
+  wake();
+}
+
+void prewarm() {
+  prewarmRequested = true;
+  wake();
+}
+
+void flush() {
+  fanout.flush();
+  wake();
+}
+
+bool configured() { return fanout.active(); }
+
+Stats stats(uint8_t endpoint) { return fanout.stats(endpoint); }
+
+} // namespace uploader
+
+} // namespace blastic
@@ -1,3 +1,4 @@
+#include <atomic>
 #include "blastic.h"
 #include "StaticTask.h"
 
@@ -11,6 +12,14 @@ static struct {
   int endTime = 0;
 } wifiReaper;
 
+// must be accessed while holding the MWifi/WifiConnection mutex
+static void (*disconnectCallback)() = nullptr;
+
+static void disconnect(decltype(WiFi) &wifi) {
+  if (disconnectCallback) disconnectCallback();
+  wifi.end();
+}
+
 static void wifiReaperLoop() [[noreturn]] {
   ulTaskNotifyTakeIndexed(0, true, portMAX_DELAY);
   while (true) {
@@ -22,7 +31,7 @@ static void wifiReaperLoop() [[noreturn]] {
       if (!blastic::wifiReaper.endTime) return wifiReaperLoop();
       now = millis();
       if (blastic::wifiReaper.endTime - now < 0) {
-        wifi->end();
+        disconnect(*wifi);
         blastic::wifiReaper.endTime = 0;
       }
       wifiReaper = blastic::wifiReaper;
@@ -35,18 +44,58 @@ static void wifiReaperLoop() [[noreturn]] {
   }
 }
 
+// these variables must be accessed while holding the MWifi/WifiConnection mutex
+static WifiConnection::Connection lastConnection{};
+// the modem is known to use DHCP: a static address may survive end() and our resets, so reset it once per boot
+static bool modemDhcp = false;
+
 WifiConnection::WifiConnection(const EEPROMConfig &config) : util::Mutexed<WiFi>() {
-  constexpr const uint32_t dhcpPollInterval = 100;
+  // each poll is a round trip to the modem, but DHCP usually completes in a few hundred milliseconds
+  constexpr const uint32_t dhcpPollInterval = 25;
   auto &wifi = *this;
-  configASSERT(!strcmp(wifi->firmwareVersion(), WIFI_FIRMWARE_LATEST_VERSION));
-  if (*this && !strncmp(wifi->SSID(), config.ssid, sizeof(config.ssid))) return;
-  wifi->end();
+  if (!firmwareOk()) return;
+  if (*this && !strncmp(wifi->SSID(), config.ssid, sizeof(config.ssid))) {
+    blastic::lastConnection.reused = true;
+    return;
+  }
+  disconnect(*wifi);
   wifiReaper = {.disconnectTimeout = config.disconnectTimeout, .endTime = 0};
+  auto &connection = blastic::lastConnection;
+  connection = {};
+  // with a static address the modem is ready as soon as it is associated
+  auto &staticIP = config.staticIP;
+  if (staticIP.ip) {
+    wifi->config(IPAddress(staticIP.ip), IPAddress(staticIP.dns), IPAddress(staticIP.gateway),
+                 IPAddress(staticIP.subnet));
+    modemDhcp = false;
+  } else if (!modemDhcp) {
+    // a zero address switches the modem back to DHCP
+    wifi->config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    modemDhcp = true;
+  }
+  auto associationStart = millis();
   if (wifi->begin(config.ssid, strnlen(config.password, sizeof(config.password)) ? config.password : nullptr) !=
       WL_CONNECTED)
     return;
   auto dhcpStart = millis();
+  connection.associationMillis = dhcpStart - associationStart;
   while (!wifi->localIP() && millis() - dhcpStart < config.dhcpTimeout * 1000) vTaskDelay(dhcpPollInterval);
+  connection.addressMillis = millis() - dhcpStart;
+  wifi->BSSID(connection.bssid);
+  connection.lease = {.ip = uint32_t(wifi->localIP()),
+                      .gateway = uint32_t(wifi->gatewayIP()),
+                      .subnet = uint32_t(wifi->subnetMask()),
+                      .dns = uint32_t(wifi->dnsIP(0))};
+}
+
+bool WifiConnection::firmwareOk() {
+  // -1 until the modem is asked
+  static std::atomic<int8_t> ok{-1};
+  if (ok < 0) {
+    MWiFi wifi;
+    if (ok < 0) ok = !strcmp(wifi->firmwareVersion(), WIFI_FIRMWARE_LATEST_VERSION);
+  }
+  return ok;
 }
 
 WifiConnection::operator bool() const {
@@ -54,20 +103,89 @@ WifiConnection::operator bool() const {
   return _this->status() == WL_CONNECTED && _this->localIP() && _this->gatewayIP();
 }
 
-int WiFiSSLClient::read() {
-  vTaskSuspendAll();
+const WifiConnection::Connection &WifiConnection::lastConnection() { return blastic::lastConnection; }
+
+void WifiConnection::onDisconnect(void (*callback)()) {
+  MWiFi wifi;
+  disconnectCallback = callback;
+}
+
+// must be accessed while holding the MWifi/WifiConnection mutex
+static WiFiSSLClient::ReadStats readStats{};
+static std::atomic<bool> bufferedReads{true};
+
+WiFiSSLClient::ReadStats WiFiSSLClient::readStats() {
+  MWiFi modem;
+  return blastic::readStats;
+}
+
+void WiFiSSLClient::bufferedReads(bool on) { blastic::bufferedReads = on; }
+
+bool WiFiSSLClient::bufferedReads() { return blastic::bufferedReads; }
+
+int WiFiSSLClient::modemRead(uint8_t *buf, size_t size) {
+  // serialize the modem transactions, the other tasks keep running
+  MWiFi modem;
+  auto start = micros();
+  if (!alive || !blastic::bufferedReads) {
+    blastic::readStats.connectedChecks++;
+    alive = ::WiFiSSLClient::connected();
+  }
   int result = -1;
-  if (connected()) result = ::WiFiSSLClient::read();
-  xTaskResumeAll();
+  if (alive) {
+    result = ::WiFiSSLClient::read(buf, size);
+    blastic::readStats.modemReads++;
+    if (result > 0) blastic::readStats.bytes += result;
+    // a short read may be the end of the stream
+    alive = result == int(size);
+  }
+  blastic::readStats.modemMicros += micros() - start;
   return result;
 }
 
+int WiFiSSLClient::available() {
+  if (rxStart != rxEnd) return rxEnd - rxStart;
+  MWiFi modem;
+  return ::WiFiSSLClient::available();
+}
+
+int WiFiSSLClient::peek() {
+  if (rxStart == rxEnd) {
+    auto result = modemRead(rxBuffer, sizeof(rxBuffer));
+    if (result <= 0) return -1;
+    rxStart = 0, rxEnd = result;
+  }
+  return rxBuffer[rxStart];
+}
+
+int WiFiSSLClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
 int WiFiSSLClient::read(uint8_t *buf, size_t size) {
-  vTaskSuspendAll();
-  int result = -1;
-  if (connected()) result = ::WiFiSSLClient::read(buf, size);
-  xTaskResumeAll();
-  return result;
+  if (rxStart == rxEnd) {
+    if (size >= sizeof(rxBuffer) || !blastic::bufferedReads) return modemRead(buf, size);
+    auto result = modemRead(rxBuffer, sizeof(rxBuffer));
+    if (result <= 0) return result;
+    rxStart = 0, rxEnd = result;
+  }
+  auto n = min(size, size_t(rxEnd - rxStart));
+  memcpy(buf, rxBuffer + rxStart, n);
+  rxStart += n;
+  return n;
+}
+
+uint8_t WiFiSSLClient::connected() {
+  if (rxStart != rxEnd) return true;
+  MWiFi modem;
+  return ::WiFiSSLClient::connected();
+}
+
+void WiFiSSLClient::stop() {
+  rxStart = rxEnd = 0, alive = false;
+  MWiFi modem;
+  ::WiFiSSLClient::stop();
 }
 
 WifiConnection::~WifiConnection() {
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "blastic.h"
+#include "Scale.h"
+
+namespace blastic {
+
+namespace scale {
+
+static std::atomic<float> offset{0};
+
+// these are accessed only by the task that calls trackZero()
+static struct {
+  float lastWeight = NAN, lastLoggedOffset = 0;
+  TickType_t lastTick = 0;
+} tracker;
+
+float zeroOffset() { return offset; }
+
+void resetZero() {
+  offset = 0;
+  tracker.lastWeight = NAN;
+  tracker.lastLoggedOffset = 0;
+}
+
+void trackZero(const EEPROMConfig &config, util::AnnotatedFloat weight, TickType_t tick, float threshold) {
+  const auto &zeroTracking = config.zeroTracking;
+  auto lastWeight = tracker.lastWeight;
+  auto elapsed = float((tick - tracker.lastTick) * portTICK_PERIOD_MS) / 1000;
+  tracker.lastWeight = weight, tracker.lastTick = tick;
+  if (!(zeroTracking.band > 0) || !(fabsf(weight) < threshold) || !(fabsf(weight - lastWeight) <= zeroTracking.maxStep))
+    return;
+  auto maxCorrection = zeroTracking.maxRate * elapsed;
+  float newOffset = offset + std::clamp(float(weight), -maxCorrection, maxCorrection);
+  offset = newOffset = std::clamp(newOffset, -zeroTracking.band, zeroTracking.band);
+  if (fabsf(newOffset - tracker.lastLoggedOffset) < zeroTracking.band / 8) return;
+  tracker.lastLoggedOffset = newOffset;
+  MSerial serial;
+  serial->print("scale: zero tracking accumulated drift ");
+  serial->println(newOffset, 4);
+}
+
+} // namespace scale
+
+} // namespace blastic
@@ -2,6 +2,10 @@
 #include <cm_backtrace/cm_backtrace.h>
 #include "blastic.h"
 #include "SerialCliTask.h"
+#include "HX711.h"
+#include "History.h"
+#include "Journal.h"
+#include "Uploader.h"
 #include "Submitter.h"
 #include "utils.h"
 
@@ -9,22 +13,34 @@ namespace blastic {
 
 // initialize configuration with sane defaults
 EEPROMConfig config = {
-    .scale = {.dataPin = 5,
-              .clockPin = 4,
+    .scale = {.clockPin = scale::defaultClockPin,
+              .channels = 1,
+              .dataChannels = {{.dataPin = scale::defaultDataPin, .trim = 1}},
               .mode = scale::HX711Mode::A128,
+              .continuous = false,
+              .timerReadout = false,
+              .autoRange = false,
               .calibrations = {{.tareRawRead = 45527,
-                                .weightRawRead = 114810,
-                                .weight = 1.56}, // works for me, but not for thee
-                               {.tareRawRead = 0, .weightRawRead = 0, .weight = 0.f},
-                               {.tareRawRead = 0, .weightRawRead = 0, .weight = 0.f}}},
+                                .points = 1,
+                                .weights = {{.rawRead = 114810, .weight = 1.56}}}, // works for me, but not for thee
+                               {.tareRawRead = 0, .points = 0, .weights = {}},
+                               {.tareRawRead = 0, .points = 0, .weights = {}}},
+              .stability = {.windowMillis = 1000, .maxDeviation = 0.005, .maxSlope = 0.01},
+              .prediction = {.window = 24, .maxUncertainty = 0.02},
+              .zeroTracking = {.band = 0.2, .maxRate = 0.001, .maxStep = 0.005},
+              .adaptive = {.resolution = 0.001, .minSamples = 4, .maxSamples = 32},
+              .checkweigher = false,
+              .checkweighing = {.trigger = 0.02, .plateauBand = 0.004, .minPlateauSamples = 5}},
     // XXX GCC bug, cannot use initializer lists with strings
     .wifi = WifiConnection::EEPROMConfig{"", "", 10, 10},
     .submit =
         Submitter::EEPROMConfig{
-            0.05, "", "",
-            Submitter::EEPROMConfig::FormParameters{
+            0.05, false, 500, "", "",
+            {Submitter::EEPROMConfig::Endpoint{
+                Submitter::EEPROMConfig::Backend::FORM,
                 "docs.google.com/forms/d/e/1FAIpQLSeI3jofIWqtWghblVPOTO1BtUbE8KmoJsGRJuRAu2ceEMIJFw/formResponse",
-                "entry.826036805", "entry.458823532", "entry.649832752", "entry.1219969504"}},
+                {"entry.826036805", "entry.458823532", "entry.649832752", "entry.1219969504"},
+                {16, 600}}}},
     .buttons = {
         {{.pin = 3,
           .threshold = 10000,
@@ -95,7 +111,7 @@ namespace scale {
 
 using namespace blastic::scale;
 
-constexpr const uint32_t scaleCliTimeout = 2000, scaleCliMaxMedianWidth = 16;
+constexpr const uint32_t scaleCliTimeout = 2000, scaleCliMaxMedianWidth = maxMedianWidth;
 
 static void mode(WordSplit &args) {
   auto modeStr = args.nextWord();
@@ -115,55 +131,488 @@ static void mode(WordSplit &args) {
   MSerial()->print("scale::mode: mode not found\n");
 }
 
+// tare and calibration points are measured in config.scale.mode, auto ranging would use the wrong calibration
+static bool rangeLocked(const char *command) {
+  if (!autoRanging(config.scale)) return true;
+  MSerial serial;
+  serial->print(command);
+  serial->print(": disable auto ranging first\n");
+  return false;
+}
+
 static void tare(WordSplit &) {
-  auto value = raw(config.scale, scaleCliMaxMedianWidth, pdMS_TO_TICKS(scaleCliTimeout));
-  if (value == readErr) {
+  if (!rangeLocked("scale::tare")) return;
+  int32_t value, channelValues[maxChannels];
+  if (!rawChannels(config.scale, value, channelValues, adaptiveMedian, pdMS_TO_TICKS(scaleCliTimeout))) {
     MSerial()->print("failed to get measurements for tare\n");
     return;
   }
   auto &calibration = config.scale.getCalibration();
   calibration.tareRawRead = value;
+  for (size_t c = 0; c < maxChannels; c++) calibration.channelTareRawReads[c] = channelValues[c];
+  calibrationChanged();
+  resetZero();
   MSerial serial;
   serial->print("scale::tare: set to raw read value ");
   serial->println(value);
 }
 
+static bool parseWeight(const char *weightString, float &weight) {
+  if (!weightString) return false;
+  char *weightEnd;
+  weight = strtof(weightString, &weightEnd);
+  return weightString != weightEnd;
+}
+
+/*
+  Calibration points management:
+    scale::calibrate <weight>         measure and add a point, or replace the point with the same weight
+    scale::calibrate remove <weight>  remove the point with the given weight
+    scale::calibrate clear            remove all points
+*/
+
 static void calibrate(WordSplit &args) {
+  auto &calibration = config.scale.getCalibration();
   auto weightString = args.nextWord();
   if (!weightString) {
     MSerial()->print("scale::calibrate: missing test weight argument\n");
     return;
   }
-  char *weightEnd;
-  auto weight = strtof(weightString, &weightEnd);
-  if (weightString == weightEnd) {
+  if (!strcmp(weightString, "clear")) {
+    calibration.points = 0;
+    calibrationChanged();
+    MSerial()->print("scale::calibrate: removed all calibration points\n");
+    return;
+  }
+  bool remove = !strcmp(weightString, "remove");
+  float weight;
+  if (!parseWeight(remove ? args.nextWord() : weightString, weight)) {
     MSerial()->print("scale::calibrate: cannot parse test weight argument\n");
     return;
   }
-  auto value = raw(config.scale, scaleCliMaxMedianWidth, pdMS_TO_TICKS(scaleCliTimeout));
+  auto points = calibration.weights, pointsEnd = points + calibration.points,
+       point = std::find_if(points, pointsEnd, [weight](auto &p) { return p.weight == weight; });
+  if (remove) {
+    if (point == pointsEnd) {
+      MSerial()->print("scale::calibrate: no calibration point with this weight\n");
+      return;
+    }
+    std::copy(point + 1, pointsEnd, point);
+    calibration.points--;
+    calibrationChanged();
+    MSerial()->print("scale::calibrate: removed calibration point\n");
+    return;
+  }
+  if (!rangeLocked("scale::calibrate")) return;
+  if (point == pointsEnd && calibration.points == maxCalibrationPoints) {
+    MSerial()->print("scale::calibrate: too many calibration points, remove one first\n");
+    return;
+  }
+  auto value = raw(config.scale, adaptiveMedian, pdMS_TO_TICKS(scaleCliTimeout));
   if (value == readErr) {
     MSerial()->print("scale::calibrate: failed to get measurements for calibration\n");
     return;
   }
-  auto &calibration = config.scale.getCalibration();
-  calibration.weightRawRead = value, calibration.weight = weight;
+  if (point == pointsEnd) calibration.points++;
+  *point = {.rawRead = value, .weight = weight};
+  calibrationChanged();
   MSerial serial;
   serial->print("scale::calibrate: set to raw read value ");
   serial->println(value);
 }
 
+static void continuous(WordSplit &args) {
+  if (auto enable = args.nextWord()) {
+    if (!strcmp(enable, "on")) config.scale.continuous = true;
+    else if (!strcmp(enable, "off")) config.scale.continuous = false;
+    else {
+      MSerial()->print("scale::continuous: argument must be on or off\n");
+      return;
+    }
+    blastic::scale::continuous(config.scale);
+  }
+  MSerial serial;
+  serial->print("scale::continuous: ");
+  serial->print(config.scale.continuous ? "on\n" : "off\n");
+}
+
+static void autorange(WordSplit &args) {
+  if (auto enable = args.nextWord()) {
+    if (!strcmp(enable, "on")) config.scale.autoRange = true;
+    else if (!strcmp(enable, "off")) config.scale.autoRange = false;
+    else {
+      MSerial()->print("scale::autorange: argument must be on or off\n");
+      return;
+    }
+  }
+  MSerial serial;
+  serial->print("scale::autorange: ");
+  serial->print(config.scale.autoRange ? "on" : "off");
+  if (config.scale.autoRange && !autoRanging(config.scale))
+    serial->print(", inactive until A128 and A64 are calibrated");
+  serial->println();
+}
+
+static void stability(WordSplit &args) {
+  auto &stability = config.scale.stability;
+  if (auto windowString = args.nextWord()) {
+    auto deviationString = args.nextWord(), slopeString = deviationString ? args.nextWord() : nullptr;
+    if (!slopeString) {
+      MSerial()->print("scale::stability: arguments are windowMillis maxDeviation maxSlope\n");
+      return;
+    }
+    char *windowEnd, *deviationEnd, *slopeEnd;
+    auto window = strtoul(windowString, &windowEnd, 10);
+    auto deviation = strtof(deviationString, &deviationEnd), slope = strtof(slopeString, &slopeEnd);
+    if (windowString == windowEnd || deviationString == deviationEnd || slopeString == slopeEnd || !window ||
+        window > uint16_t(-1)) {
+      MSerial()->print("scale::stability: cannot parse arguments\n");
+      return;
+    }
+    stability = {.windowMillis = uint16_t(window), .maxDeviation = deviation, .maxSlope = slope};
+  }
+  MSerial serial;
+  serial->print("scale::stability: windowMillis ");
+  serial->print(stability.windowMillis);
+  serial->print(" maxDeviation ");
+  serial->print(stability.maxDeviation, 4);
+  serial->print(" maxSlope ");
+  serial->println(stability.maxSlope, 4);
+}
+
+static void prediction(WordSplit &args) {
+  auto &prediction = config.scale.prediction;
+  if (auto windowString = args.nextWord()) {
+    auto uncertaintyString = args.nextWord();
+    if (!uncertaintyString) {
+      MSerial()->print("scale::prediction: arguments are window maxUncertainty\n");
+      return;
+    }
+    char *windowEnd, *uncertaintyEnd;
+    auto window = strtoul(windowString, &windowEnd, 10);
+    auto uncertainty = strtof(uncertaintyString, &uncertaintyEnd);
+    if (windowString == windowEnd || uncertaintyString == uncertaintyEnd || window < SettlingPredictor::minWindow ||
+        window > SettlingPredictor::capacity) {
+      MSerial()->print("scale::prediction: cannot parse arguments\n");
+      return;
+    }
+    prediction = {.window = uint8_t(window), .maxUncertainty = uncertainty};
+  }
+  MSerial serial;
+  serial->print("scale::prediction: window ");
+  serial->print(prediction.window);
+  serial->print(" maxUncertainty ");
+  serial->println(prediction.maxUncertainty, 4);
+}
+
+static void zero(WordSplit &args) {
+  auto &zeroTracking = config.scale.zeroTracking;
+  if (auto bandString = args.nextWord()) {
+    if (!strcmp(bandString, "reset")) resetZero();
+    else {
+      auto rateString = args.nextWord(), stepString = rateString ? args.nextWord() : nullptr;
+      float band, rate, step;
+      if (!parseWeight(bandString, band) || !parseWeight(rateString, rate) || !parseWeight(stepString, step)) {
+        MSerial()->print("scale::zero: arguments are reset, or band maxRate maxStep\n");
+        return;
+      }
+      zeroTracking = {.band = band, .maxRate = rate, .maxStep = step};
+    }
+  }
+  MSerial serial;
+  serial->print("scale::zero: band ");
+  serial->print(zeroTracking.band, 4);
+  serial->print(" maxRate ");
+  serial->print(zeroTracking.maxRate, 4);
+  serial->print(" maxStep ");
+  serial->print(zeroTracking.maxStep, 4);
+  serial->print(" offset ");
+  serial->println(zeroOffset(), 4);
+}
+
+/*
+  Wiring of the HX711 controllers sharing the clock pin:
+    scale::channels                           show the wiring
+    scale::channels <clockPin> <dataPin>...   set the clock pin and one data pin per channel
+*/
+
+static void channels(WordSplit &args) {
+  auto &scale = config.scale;
+  if (auto clockString = args.nextWord()) {
+    uint8_t dataPins[maxChannels], channels = 0;
+    for (const char *dataString; (dataString = args.nextWord());) {
+      if (channels == maxChannels) {
+        MSerial()->print("scale::channels: too many channels\n");
+        return;
+      }
+      char *dataEnd;
+      auto dataPin = strtoul(dataString, &dataEnd, 10);
+      if (dataEnd == dataString || *dataEnd || !hx711::validPin(dataPin)) {
+        MSerial()->print("scale::channels: invalid data pin\n");
+        return;
+      }
+      dataPins[channels++] = dataPin;
+    }
+    if (!channels) {
+      MSerial()->print("scale::channels: arguments are clockPin dataPin...\n");
+      return;
+    }
+    char *clockEnd;
+    auto clockPin = strtoul(clockString, &clockEnd, 10);
+    if (clockEnd == clockString || *clockEnd || !hx711::validPin(clockPin)) {
+      MSerial()->print("scale::channels: invalid clock pin\n");
+      return;
+    }
+    scale.clockPin = clockPin;
+    // new channels start with a neutral trim
+    for (uint8_t c = 0; c < channels; c++) {
+      if (c >= scale.channels) scale.dataChannels[c].trim = 1;
+      scale.dataChannels[c].dataPin = dataPins[c];
+    }
+    scale.channels = channels;
+  }
+  MSerial serial;
+  serial->print("scale::channels: clockPin ");
+  serial->print(scale.clockPin);
+  serial->print(" dataPin:trim");
+  for (uint8_t c = 0; c < scale.channels; c++) {
+    serial->print(' ');
+    serial->print(scale.dataChannels[c].dataPin);
+    serial->print(':');
+    serial->print(scale.dataChannels[c].trim, 4);
+  }
+  serial->println();
+}
+
+static void trim(WordSplit &args) {
+  auto channelString = args.nextWord(), trimString = channelString ? args.nextWord() : nullptr;
+  char *channelEnd, *trimEnd;
+  auto channel = trimString ? strtoul(channelString, &channelEnd, 10) : 0;
+  auto trim = trimString ? strtof(trimString, &trimEnd) : 0;
+  if (!trimString || channelString == channelEnd || trimString == trimEnd || channel >= config.scale.channels) {
+    MSerial()->print("scale::trim: arguments are channel trim\n");
+    return;
+  }
+  config.scale.dataChannels[channel].trim = trim;
+  MSerial serial;
+  serial->print("scale::trim: channel ");
+  serial->print(channel);
+  serial->print(" trim set to ");
+  serial->println(trim, 4);
+}
+
+/*
+  Corner load view: raw read and share of the weight of each channel.
+*/
+
+static void corners(WordSplit &args) {
+  auto medianWidthArg = args.nextWord();
+  auto medianWidth = min(max(1, medianWidthArg ? atoi(medianWidthArg) : 1), scaleCliMaxMedianWidth);
+  int32_t value, channelValues[maxChannels];
+  if (!rawChannels(config.scale, value, channelValues, medianWidth, pdMS_TO_TICKS(scaleCliTimeout))) {
+    MSerial()->print("scale::corners: HX711 error\n");
+    return;
+  }
+  auto total = blastic::scale::weight(config.scale, value, config.scale.mode);
+  float channelWeights[maxChannels];
+  if (total != weightCal) blastic::scale::channelWeights(config.scale, channelValues, total, channelWeights);
+  MSerial serial;
+  serial->print("scale::corners: raw ");
+  serial->print(value);
+  serial->print(" weight ");
+  total == weightCal ? serial->print("uncalibrated") : serial->print(total, 3);
+  serial->print(" raw:weight");
+  for (uint8_t c = 0; c < config.scale.channels; c++) {
+    serial->print(' ');
+    serial->print(channelValues[c]);
+    serial->print(':');
+    total == weightCal ? serial->print('-') : serial->print(channelWeights[c], 3);
+  }
+  serial->println();
+}
+
+static void adaptive(WordSplit &args) {
+  auto &adaptive = config.scale.adaptive;
+  if (auto resolutionString = args.nextWord()) {
+    auto minString = args.nextWord(), maxString = minString ? args.nextWord() : nullptr;
+    float resolution;
+    char *minEnd, *maxEnd;
+    auto minSamples = maxString ? strtoul(minString, &minEnd, 10) : 0;
+    auto maxSamples = maxString ? strtoul(maxString, &maxEnd, 10) : 0;
+    if (!parseWeight(resolutionString, resolution) || !maxString || minString == minEnd || maxString == maxEnd ||
+        !minSamples || minSamples > maxSamples || maxSamples > maxMedianWidth) {
+      MSerial serial;
+      serial->print("scale::adaptive: arguments are resolution minSamples maxSamples, at most ");
+      serial->println(maxMedianWidth);
+      return;
+    }
+    adaptive = {.resolution = resolution, .minSamples = uint8_t(minSamples), .maxSamples = uint8_t(maxSamples)};
+  }
+  MSerial serial;
+  serial->print("scale::adaptive: resolution ");
+  serial->print(adaptive.resolution, 4);
+  serial->print(" minSamples ");
+  serial->print(adaptive.minSamples);
+  serial->print(" maxSamples ");
+  serial->print(adaptive.maxSamples);
+  serial->print(" last noise ");
+  serial->println(noise(), 1);
+}
+
+/*
+  In-motion weighing:
+    scale::checkweigher on|off                                 start or stop, on also starts continuous acquisition
+    scale::checkweigher <trigger> <plateauBand> <minPlateau>   set the segmentation parameters
+*/
+
+static void checkweigher(WordSplit &args) {
+  auto &checkweighing = config.scale.checkweighing;
+  if (auto firstArg = args.nextWord()) {
+    if (!strcmp(firstArg, "on") || !strcmp(firstArg, "off")) {
+      config.scale.checkweigher = !strcmp(firstArg, "on");
+      if (config.scale.checkweigher && !config.scale.continuous) {
+        config.scale.continuous = true;
+        blastic::scale::continuous(config.scale);
+      }
+      blastic::scale::checkweigher(config.scale);
+    } else {
+      auto bandString = args.nextWord(), minPlateauString = bandString ? args.nextWord() : nullptr;
+      float trigger, band;
+      char *minPlateauEnd;
+      auto minPlateau = minPlateauString ? strtoul(minPlateauString, &minPlateauEnd, 10) : 0;
+      if (!parseWeight(firstArg, trigger) || !parseWeight(bandString, band) || !minPlateauString ||
+          minPlateauString == minPlateauEnd || minPlateau > Checkweigher::capacity || trigger <= 0) {
+        MSerial()->print("scale::checkweigher: arguments are on, off, or trigger plateauBand minPlateauSamples\n");
+        return;
+      }
+      checkweighing = {.trigger = trigger, .plateauBand = band, .minPlateauSamples = uint8_t(minPlateau)};
+    }
+  }
+  MSerial serial;
+  serial->print("scale::checkweigher: ");
+  serial->print(config.scale.checkweigher ? "on" : "off");
+  serial->print(" trigger ");
+  serial->print(checkweighing.trigger, 4);
+  serial->print(" plateauBand ");
+  serial->print(checkweighing.plateauBand, 4);
+  serial->print(" minPlateauSamples ");
+  serial->println(checkweighing.minPlateauSamples);
+}
+
+static void items(WordSplit &args) {
+  auto countArg = args.nextWord();
+  uint32_t count = countArg ? max(1, atoi(countArg)) : 10, total = checkweighedItems();
+  Checkweigher::Item first, last;
+  MSerial serial;
+  serial->print("scale::items: total ");
+  serial->println(total);
+  bool haveFirst = false;
+  for (uint32_t i = total > count ? total - count : 0; i < total; i++) {
+    Checkweigher::Item item;
+    if (!checkweighedItem(i, item)) continue;
+    if (!haveFirst) first = item, haveFirst = true;
+    last = item;
+    serial->print(item.sequence);
+    serial->print(" ms ");
+    serial->print(item.start * portTICK_PERIOD_MS);
+    serial->print('-');
+    serial->print(item.end * portTICK_PERIOD_MS);
+    serial->print(" weight ");
+    serial->print(item.weight, 3);
+    serial->print(item.stable ? " stable" : " unstable");
+    serial->print(" samples ");
+    serial->print(item.samples);
+    serial->print(" plateau ");
+    serial->println(item.plateauSamples);
+  }
+  // items starting at the same tick (e.g. one item only) give no rate
+  if (!haveFirst || last.start == first.start) return;
+  serial->print("scale::items: items per minute ");
+  serial->println(float(last.sequence - first.sequence) * 60000 / ((last.start - first.start) * portTICK_PERIOD_MS));
+}
+
+/*
+  Binary raw sample stream, decode it on the host with scripts/stream-decoder.cpp. On also starts continuous
+  acquisition.
+*/
+
+static void stream(WordSplit &args) {
+  if (auto enable = args.nextWord()) {
+    bool on = !strcmp(enable, "on");
+    if (!on && strcmp(enable, "off")) {
+      MSerial()->print("scale::stream: argument must be on or off\n");
+      return;
+    }
+    if (on && !config.scale.continuous) {
+      config.scale.continuous = true;
+      blastic::scale::continuous(config.scale);
+    }
+    stream::enable(config.scale, on);
+  }
+  auto stats = stream::getStats();
+  MSerial serial;
+  serial->print("scale::stream: ");
+  serial->print(stream::enabled() ? "on" : "off");
+  serial->print(" frames ");
+  serial->print(stats.frames);
+  serial->print(" samples ");
+  serial->print(stats.samples);
+  serial->print(" lost ");
+  serial->println(stats.lost);
+}
+
+static void readout(WordSplit &args) {
+  if (auto readoutString = args.nextWord()) {
+    if (!strcmp(readoutString, "timer")) config.scale.timerReadout = true;
+    else if (!strcmp(readoutString, "critical")) config.scale.timerReadout = false;
+    else {
+      MSerial()->print("scale::readout: argument must be timer or critical\n");
+      return;
+    }
+  }
+  MSerial serial;
+  serial->print("scale::readout: ");
+  serial->print(config.scale.timerReadout ? "timer\n" : "critical\n");
+}
+
+static void timings(WordSplit &) {
+  auto timerStats = hx711::timerStats();
+  MSerial serial;
+  serial->print("scale::timings: critical section us last max reads");
+  for (auto fixedPins : {true, false}) {
+    auto stats = criticalSectionStats(fixedPins);
+    serial->print(fixedPins ? " fixed pins " : " runtime pins ");
+    serial->print(float(stats.last) * 1000000 / SystemCoreClock, 2);
+    serial->print(' ');
+    serial->print(float(stats.max) * 1000000 / SystemCoreClock, 2);
+    serial->print(' ');
+    serial->print(stats.count);
+  }
+  serial->print(" timer frame us last ");
+  serial->print(float(timerStats.lastCycles) * 1000000 / SystemCoreClock, 2);
+  serial->print(" frames ");
+  serial->print(timerStats.frames);
+  serial->print(" failures ");
+  serial->println(timerStats.failures);
+}
+
 static void configuration(WordSplit &) {
   auto modeString = modeStrings[uint32_t(config.scale.mode)];
   auto &calibration = config.scale.getCalibration();
   MSerial serial;
   serial->print("scale::configuration: mode ");
   serial->print(modeString);
-  serial->print(" tareRawRead weightRawRead weight ");
+  serial->print(config.scale.continuous ? " continuous" : " one-shot");
+  serial->print(" tareRawRead ");
   serial->print(calibration.tareRawRead);
-  serial->print(' ');
-  serial->print(calibration.weightRawRead);
-  serial->print(' ');
-  serial->println(calibration.weight);
+  serial->print(" rawRead:weight");
+  for (auto point = calibration.weights; point < calibration.weights + calibration.points; point++) {
+    serial->print(' ');
+    serial->print(point->rawRead);
+    serial->print(':');
+    serial->print(point->weight, 3);
+  }
+  serial->println();
 }
 
 static void raw(WordSplit &args) {
@@ -183,11 +632,62 @@ static void weight(WordSplit &args) {
   serial->print("scale::weight: ");
   if (value == weightCal) serial->print("uncalibrated\n");
   else if (value == weightErr) serial->print("HX711 error\n");
+  else if (value == weightSat) serial->print("saturated\n");
   else serial->println(value);
 }
 
 } // namespace scale
 
+namespace history {
+
+using namespace blastic::history;
+
+static uint32_t parseSeconds(WordSplit &args) {
+  auto secondsArg = args.nextWord();
+  return secondsArg ? max(1, atoi(secondsArg)) : 60;
+}
+
+static void stats(WordSplit &args) {
+  auto seconds = parseSeconds(args);
+  auto stats = blastic::history::stats(seconds);
+  MSerial serial;
+  serial->print("history::stats: last ");
+  serial->print(seconds);
+  serial->print("s covered ");
+  serial->print(stats.seconds);
+  serial->print("s min ");
+  serial->print(stats.min, 3);
+  serial->print(" max ");
+  serial->print(stats.max, 3);
+  serial->print(" mean ");
+  serial->print(stats.mean, 3);
+  serial->print(" bytes ");
+  serial->println(bytesUsed());
+}
+
+// one line per record: start second, seconds, min, max, mean
+static void dump(WordSplit &args) {
+  uint32_t now = xTaskGetTickCount() / configTICK_RATE_HZ, seconds = parseSeconds(args),
+           from = now > seconds ? now - seconds : 0;
+  Record record;
+  for (Cursor cursor; next(cursor, record);) {
+    if (record.second + record.seconds <= from) continue;
+    MSerial serial;
+    serial->print("history::dump: ");
+    serial->print(record.second);
+    serial->print(' ');
+    serial->print(record.seconds);
+    serial->print(' ');
+    serial->print(record.min, 3);
+    serial->print(' ');
+    serial->print(record.max, 3);
+    serial->print(' ');
+    serial->println(record.mean, 3);
+  }
+}
+
+} // namespace history
+
 namespace wifi {
 
 static void status(WordSplit &) {
@@ -198,11 +698,27 @@ static void status(WordSplit &) {
     status = wifi->status();
     strcpy0(firmwareVersion, wifi->firmwareVersion());
   }
+  auto readStats = blastic::WiFiSSLClient::readStats();
   MSerial serial;
   serial->print("wifi::status: status ");
   serial->print(status);
   serial->print(" version ");
   serial->println(firmwareVersion);
+  serial->print("wifi::status: tls reads ");
+  serial->print(readStats.modemReads);
+  serial->print(" connected checks ");
+  serial->print(readStats.connectedChecks);
+  serial->print(" bytes ");
+  serial->print(readStats.bytes);
+  serial->print(" modem time ");
+  serial->print(readStats.modemMicros);
+  serial->print("us");
+  if (readStats.bytes >= 1024) {
+    serial->print(" (");
+    serial->print(readStats.modemMicros / (readStats.bytes / 1024));
+    serial->print("us/KB)");
+  }
+  serial->println();
 }
 
 static void timeout(WordSplit &args) {
@@ -243,12 +759,9 @@ static void password(WordSplit &args) {
 }
 
 static void connect(WordSplit &) {
-  {
-    MWiFi wifi;
-    if (strcmp(wifi->firmwareVersion(), WIFI_FIRMWARE_LATEST_VERSION)) {
-      MSerial()->print("wifi::connect: bad wifi firmware, need version " WIFI_FIRMWARE_LATEST_VERSION "\n");
-      return;
-    }
+  if (!WifiConnection::firmwareOk()) {
+    MSerial()->print("wifi::connect: bad wifi firmware, need version " WIFI_FIRMWARE_LATEST_VERSION "\n");
+    return;
   }
   if (!strlen(config.wifi.ssid)) {
     MSerial()->print("wifi::connect: configure the connection first with wifi::ssid\n");
@@ -257,8 +770,11 @@ static void connect(WordSplit &) {
   uint8_t bssid[6];
   int32_t rssi;
   IPAddress ip, gateway, dns1, dns2;
+  WifiConnection::Connection connection;
   {
+    auto start = millis();
     WifiConnection wifi(config.wifi);
+    auto elapsed = millis() - start;
     auto status = wifi->status();
     if (status != WL_CONNECTED) {
       MSerial serial;
@@ -267,7 +783,20 @@ static void connect(WordSplit &) {
       serial->print(")\n");
       return;
     }
-    MSerial()->print("wifi::connect: connected\n");
+    connection = WifiConnection::lastConnection();
+    {
+      MSerial serial;
+      serial->print("wifi::connect: connected in ");
+      serial->print(elapsed);
+      if (connection.reused) serial->print("ms, already up\n");
+      else {
+        serial->print("ms, association ");
+        serial->print(connection.associationMillis);
+        serial->print("ms address ");
+        serial->print(connection.addressMillis);
+        serial->print(config.wifi.staticIP.ip ? "ms (static)\n" : "ms (dhcp)\n");
+      }
+    }
     wifi->BSSID(bssid);
     rssi = wifi->RSSI();
     ip = wifi->localIP(), gateway = wifi->gatewayIP(), dns1 = wifi->dnsIP(0), dns2 = wifi->dnsIP(1);
@@ -288,6 +817,58 @@ static void connect(WordSplit &) {
   serial->println(dns2);
 }
 
+/*
+  Static address, to skip DHCP at each connection: wifi::staticIP off, wifi::staticIP lease to pin the address obtained
+  with the last DHCP connection, or wifi::staticIP ip gateway subnet dns. It takes effect at the next connection.
+*/
+
+static void staticIP(WordSplit &args) {
+  auto &staticIP = config.wifi.staticIP;
+  if (auto first = args.nextWord()) {
+    if (!strcmp(first, "off")) staticIP = {};
+    else if (!strcmp(first, "lease")) {
+      WifiConnection::IPv4Config lease;
+      {
+        MWiFi wifi;
+        lease = WifiConnection::lastConnection().lease;
+      }
+      if (!lease.ip) {
+        MSerial()->print("wifi::staticIP: no lease, connect first with wifi::connect\n");
+        return;
+      }
+      staticIP = lease;
+    } else {
+      IPAddress addresses[4];
+      bool parsed = addresses[0].fromString(first);
+      for (size_t i = 1; parsed && i < std::size(addresses); i++) {
+        auto word = args.nextWord();
+        parsed = word && addresses[i].fromString(word);
+      }
+      if (!parsed || !uint32_t(addresses[0])) {
+        MSerial()->print("wifi::staticIP: arguments must be off, lease, or ip gateway subnet dns\n");
+        return;
+      }
+      staticIP = {.ip = uint32_t(addresses[0]),
+                  .gateway = uint32_t(addresses[1]),
+                  .subnet = uint32_t(addresses[2]),
+                  .dns = uint32_t(addresses[3])};
+    }
+  }
+  MSerial serial;
+  serial->print("wifi::staticIP: ");
+  if (!staticIP.ip) {
+    serial->print("off\n");
+    return;
+  }
+  serial->print(IPAddress(staticIP.ip));
+  serial->print(" gateway ");
+  serial->print(IPAddress(staticIP.gateway));
+  serial->print(" subnet ");
+  serial->print(IPAddress(staticIP.subnet));
+  serial->print(" dns ");
+  serial->println(IPAddress(staticIP.dns));
+}
+
 } // namespace wifi
 
 namespace tls {
@@ -316,12 +897,9 @@ static void ping(WordSplit &args) {
     MSerial()->print("tls::ping: invalid port\n");
     return;
   }
-  {
-    MWiFi wifi;
-    if (strcmp(wifi->firmwareVersion(), WIFI_FIRMWARE_LATEST_VERSION)) {
-      MSerial()->print("tls::ping: bad wifi firmware, need version " WIFI_FIRMWARE_LATEST_VERSION "\n");
-      return;
-    }
+  if (!WifiConnection::firmwareOk()) {
+    MSerial()->print("tls::ping: bad wifi firmware, need version " WIFI_FIRMWARE_LATEST_VERSION "\n");
+    return;
   }
   WifiConnection wifi(config.wifi);
   if (!wifi) {
@@ -331,7 +909,11 @@ static void ping(WordSplit &args) {
   MSerial()->print("tls::ping: connected to wifi\n");
 
   {
-    blastic::WiFiSSLClient client;
+    // static, the receive buffer is large for the stack of the CLI task
+    static blastic::WiFiSSLClient client;
+    struct Closer {
+      ~Closer() { client.stop(); }
+    } closer;
     if (!client.connect(address, port)) {
       MSerial()->print("tls::ping: failed to connect to server\n");
       return;
@@ -353,7 +935,10 @@ static void ping(WordSplit &args) {
 
     constexpr const size_t maxLen = std::min(255, SERIAL_BUFFER_SIZE - 1);
     uint8_t tlsInput[maxLen];
-    constexpr const unsigned int waitingReadInterval = 100;
+    constexpr const unsigned int waitingReadInterval = 10;
+    auto statsBefore = blastic::WiFiSSLClient::readStats();
+    auto start = millis();
+    uint32_t received = 0;
     while (true) {
       // this is non blocking as the underlying code may return zero (and available() == 0) while still being connected
       auto len = client.read(tlsInput, maxLen);
@@ -362,13 +947,45 @@ static void ping(WordSplit &args) {
         vTaskDelay(pdMS_TO_TICKS(waitingReadInterval));
         continue;
       }
+      received += len;
       MSerial()->write(tlsInput, len);
     }
+    // throughput of the response, to compare tls::bufferedReads on and off
+    auto elapsed = millis() - start;
+    auto stats = blastic::WiFiSSLClient::readStats();
+    MSerial serial;
+    serial->print("\ntls::ping: received ");
+    serial->print(received);
+    serial->print(" bytes in ");
+    serial->print(elapsed);
+    serial->print("ms (");
+    serial->print(elapsed ? uint32_t(uint64_t(received) * 1000 / elapsed) : 0);
+    serial->print(" B/s) modem reads ");
+    serial->print(stats.modemReads - statsBefore.modemReads);
+    serial->print(" connected checks ");
+    serial->print(stats.connectedChecks - statsBefore.connectedChecks);
+    serial->print(" modem time ");
+    serial->print(stats.modemMicros - statsBefore.modemMicros);
+    serial->print("us");
   }
 
   MSerial()->print("\ntls::ping: connection closed\n");
 }
 
+static void bufferedReads(WordSplit &args) {
+  if (auto enable = args.nextWord()) {
+    if (!strcmp(enable, "on")) blastic::WiFiSSLClient::bufferedReads(true);
+    else if (!strcmp(enable, "off")) blastic::WiFiSSLClient::bufferedReads(false);
+    else {
+      MSerial()->print("tls::bufferedReads: argument must be on or off\n");
+      return;
+    }
+  }
+  MSerial serial;
+  serial->print("tls::bufferedReads: ");
+  serial->print(blastic::WiFiSSLClient::bufferedReads() ? "on\n" : "off\n");
+}
+
 } // namespace tls
 
 namespace submit {
@@ -384,6 +1001,99 @@ static void threshold(WordSplit &args) {
   serial->println(config.submit.threshold, 3);
 }
 
+static void captureSettled(WordSplit &args) {
+  if (auto enable = args.nextWord()) {
+    if (!strcmp(enable, "on")) config.submit.captureSettled = true;
+    else if (!strcmp(enable, "off")) config.submit.captureSettled = false;
+    else {
+      MSerial()->print("submit::captureSettled: argument must be on or off\n");
+      return;
+    }
+  }
+  MSerial serial;
+  serial->print("submit::captureSettled: ");
+  serial->print(config.submit.captureSettled ? "on\n" : "off\n");
+}
+
+static void captureWindow(WordSplit &args) {
+  if (auto windowString = args.nextWord()) {
+    char *windowEnd;
+    auto window = strtoul(windowString, &windowEnd, 10);
+    if (windowString == windowEnd || window > uint16_t(-1)) {
+      MSerial()->print("submit::captureWindow: argument must be milliseconds, 0 to disable\n");
+      return;
+    }
+    config.submit.captureWindow = window;
+  }
+  MSerial serial;
+  serial->print("submit::captureWindow: ");
+  serial->println(config.submit.captureWindow);
+}
+
+/*
+  Submissions waiting in the journal for the uploader task. With retry, try to upload now.
+*/
+
+static void queue(WordSplit &args) {
+  if (auto retry = args.nextWord()) {
+    if (strcmp(retry, "retry")) {
+      MSerial()->print("submit::queue: the only argument is retry\n");
+      return;
+    }
+    uploader::wake();
+  }
+  auto journalStats = journal::stats();
+  MSerial serial;
+  serial->print("submit::queue: pending ");
+  serial->print(journalStats.pending);
+  serial->print(" free ");
+  serial->print(journalStats.freeSlots);
+  serial->print(" flash errors ");
+  serial->println(journalStats.writeErrors);
+  for (uint8_t endpoint = 0; endpoint < journal::maxEndpoints; endpoint++) {
+    if (config.submit.endpoints[endpoint].backend == Submitter::EEPROMConfig::Backend::NONE) continue;
+    auto uploaderStats = uploader::stats(endpoint);
+    journal::Submission oldest;
+    bool haveOldest = journal::front(endpoint, &oldest, 1);
+    serial->print("submit::queue: endpoint ");
+    serial->print(endpoint);
+    serial->print(" pending ");
+    serial->print(journal::pending(endpoint));
+    if (haveOldest) {
+      serial->print(" oldest ");
+      if (oldest.thisBoot) {
+        serial->print(xTaskGetTickCount() / configTICK_RATE_HZ - oldest.seconds);
+        serial->print("s ago");
+      } else serial->print("from before the last boot");
+    }
+    serial->print(" uploaded ");
+    serial->print(uploaderStats.uploaded);
+    serial->print(" dropped ");
+    serial->print(uploaderStats.dropped);
+    serial->print(" failures ");
+    serial->print(uploaderStats.failures);
+    serial->print(" last status ");
+    serial->print(uploaderStats.lastStatus);
+    serial->print(" handshakes ");
+    serial->print(uploaderStats.handshakes);
+    serial->print(" reuses ");
+    serial->print(uploaderStats.reuses);
+    serial->print(" requests ");
+    serial->print(uploaderStats.requests);
+    if (uploaderStats.latency) {
+      serial->print(" last delivery ");
+      serial->print(uploaderStats.latency);
+      serial->print("ms");
+    }
+    if (uploaderStats.backoff) {
+      serial->print(" retry every ");
+      serial->print(uploaderStats.backoff);
+      serial->print('s');
+    }
+    serial->println();
+  }
+}
+
 static void collectionPoint(WordSplit &args) {
   if (auto collectionPoint = args.rest()) strcpy0(config.submit.collectionPoint, collectionPoint);
   MSerial serial;
@@ -419,7 +1129,110 @@ static void urn(WordSplit &args) {
   strcpy0(config.submit.collectionPoint, urn);
   MSerial serial;
   serial->print("submit::urn: collection point ");
-  serial->println(config.submit.form.urn);
+  serial->println(config.submit.endpoints[0].urn);
+}
+
+/*
+  Submission endpoints, each submission is delivered to all the enabled ones. A form endpoint posts one submission per
+  request, with the given form field names. A batch endpoint posts JSON lines, once maxRecords submissions are queued
+  or the oldest is maxAge seconds old (or the scale goes idle).
+*/
+
+static void printEndpoint(MSerial &serial, uint8_t index) {
+  auto &endpoint = config.submit.endpoints[index];
+  serial->print("submit::endpoint: ");
+  serial->print(index);
+  switch (endpoint.backend) {
+  case Submitter::EEPROMConfig::Backend::FORM:
+    serial->print(" form ");
+    serial->print(endpoint.urn);
+    serial->print(" type ");
+    serial->print(endpoint.form.type);
+    serial->print(" collectionPoint ");
+    serial->print(endpoint.form.collectionPoint);
+    serial->print(" collectorName ");
+    serial->print(endpoint.form.collectorName);
+    serial->print(" weight ");
+    serial->println(endpoint.form.weight);
+    return;
+  case Submitter::EEPROMConfig::Backend::BATCH:
+    serial->print(" batch ");
+    serial->print(endpoint.urn);
+    serial->print(" maxRecords ");
+    serial->print(endpoint.batch.maxRecords);
+    serial->print(" maxAge ");
+    serial->println(endpoint.batch.maxAge);
+    return;
+  default: serial->print(" none\n");
+  }
+}
+
+static void endpoint(WordSplit &args) {
+  using Backend = Submitter::EEPROMConfig::Backend;
+  auto indexString = args.nextWord();
+  if (!indexString) {
+    MSerial serial;
+    for (uint8_t index = 0; index < journal::maxEndpoints; index++) printEndpoint(serial, index);
+    return;
+  }
+  char *end;
+  auto index = strtoul(indexString, &end, 10);
+  if (end == indexString || index >= journal::maxEndpoints) {
+    MSerial serial;
+    serial->print("submit::endpoint: index must be between 0 and ");
+    serial->println(journal::maxEndpoints - 1);
+    return;
+  }
+  auto &endpoint = config.submit.endpoints[index];
+  if (auto backendString = args.nextWord()) {
+    auto urn = args.nextWord();
+    if (urn && (strstr(urn, "https://") == urn || strstr(urn, "http://") == urn)) {
+      MSerial()->print("submit::endpoint: specify the urn argument without http:// or https://\n");
+      return;
+    }
+    if (!strcmp(backendString, "none")) endpoint.backend = Backend::NONE;
+    else if (!strcmp(backendString, "form")) {
+      auto type = args.nextWord(), collectionPoint = args.nextWord(), collectorName = args.nextWord(),
+           weight = args.nextWord();
+      if (!urn || !weight) {
+        MSerial()->print("submit::endpoint: form needs urn type collectionPoint collectorName weight\n");
+        return;
+      }
+      strcpy0(endpoint.urn, urn);
+      strcpy0(endpoint.form.type, type);
+      strcpy0(endpoint.form.collectionPoint, collectionPoint);
+      strcpy0(endpoint.form.collectorName, collectorName);
+      strcpy0(endpoint.form.weight, weight);
+      endpoint.backend = Backend::FORM;
+    } else if (!strcmp(backendString, "batch")) {
+      auto maxRecordsString = args.nextWord(), maxAgeString = args.nextWord();
+      auto maxRecords = maxRecordsString ? strtoul(maxRecordsString, &end, 10) : endpoint.batch.maxRecords;
+      if (maxRecordsString && (end == maxRecordsString || !maxRecords || maxRecords > uploader::maxBatch)) {
+        MSerial serial;
+        serial->print("submit::endpoint: maxRecords must be between 1 and ");
+        serial->println(uploader::maxBatch);
+        return;
+      }
+      auto maxAge = maxAgeString ? strtoul(maxAgeString, &end, 10) : endpoint.batch.maxAge;
+      if (maxAgeString && (end == maxAgeString || maxAge > uint16_t(-1))) {
+        MSerial()->print("submit::endpoint: maxAge must be seconds\n");
+        return;
+      }
+      if (!urn) {
+        MSerial()->print("submit::endpoint: batch needs urn [maxRecords [maxAge]]\n");
+        return;
+      }
+      strcpy0(endpoint.urn, urn);
+      endpoint.batch.maxRecords = maxRecords, endpoint.batch.maxAge = maxAge;
+      endpoint.backend = Backend::BATCH;
+    } else {
+      MSerial()->print("submit::endpoint: backend must be none, form or batch\n");
+      return;
+    }
+    uploader::wake();
+  }
+  MSerial serial;
+  printEndpoint(serial, index);
 }
 
 static void action(WordSplit &args) {
@@ -445,18 +1258,40 @@ static constexpr const CliCallback callbacks[]{makeCliCallback(version),
                                                makeCliCallback(scale::mode),
                                                makeCliCallback(scale::tare),
                                                makeCliCallback(scale::calibrate),
+                                               makeCliCallback(scale::continuous),
+                                               makeCliCallback(scale::autorange),
+                                               makeCliCallback(scale::stability),
+                                               makeCliCallback(scale::prediction),
+                                               makeCliCallback(scale::zero),
+                                               makeCliCallback(scale::channels),
+                                               makeCliCallback(scale::trim),
+                                               makeCliCallback(scale::corners),
+                                               makeCliCallback(scale::adaptive),
+                                               makeCliCallback(scale::checkweigher),
+                                               makeCliCallback(scale::items),
+                                               makeCliCallback(scale::stream),
+                                               makeCliCallback(scale::readout),
+                                               makeCliCallback(scale::timings),
                                                makeCliCallback(scale::configuration),
                                                makeCliCallback(scale::raw),
                                                makeCliCallback(scale::weight),
+                                               makeCliCallback(history::stats),
+                                               makeCliCallback(history::dump),
                                                makeCliCallback(wifi::status),
                                                makeCliCallback(wifi::ssid),
                                                makeCliCallback(wifi::password),
                                                makeCliCallback(wifi::connect),
+                                               makeCliCallback(wifi::staticIP),
                                                makeCliCallback(tls::ping),
+                                               makeCliCallback(tls::bufferedReads),
                                                makeCliCallback(submit::threshold),
+                                               makeCliCallback(submit::captureSettled),
+                                               makeCliCallback(submit::captureWindow),
+                                               makeCliCallback(submit::queue),
                                                makeCliCallback(submit::collectionPoint),
                                                makeCliCallback(submit::collectorName),
                                                makeCliCallback(submit::urn),
+                                               makeCliCallback(submit::endpoint),
                                                makeCliCallback(submit::action),
                                                CliCallback()};
 
@@ -479,7 +1314,7 @@ namespace buttons {
 void edgeCallback(size_t i, bool rising) {
   // NB: this is run in an interrupt context, do not do anything heavyweight
   if (!rising) return;
-  return submitter().action_ISR(std::get<Submitter::Action>(Submitter::actions[i + 1]));
+  return submitter().action_ISR(std::get<Submitter::Action>(Submitter::actions[i + 1]), xTaskGetTickCountFromISR());
 }
 
 } // namespace buttons
@@ -492,9 +1327,16 @@ void setup() {
   while (!Serial);
   Serial.print("setup: booting blastic-scale version ");
   Serial.println(version);
+  if (journal::begin()) {
+    Serial.print("journal: pending submissions ");
+    Serial.println(journal::stats().pending);
+  } else Serial.print("journal: cannot open the data flash\n");
   submitter();
   cliTask();
+  scale::continuous(config.scale);
+  scale::checkweigher(config.scale);
   buttons::reset(config.buttons);
+  uploader::start();
   Serial.print("setup: done\n");
 }
 
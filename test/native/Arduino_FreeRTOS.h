@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+/*
+  Host stand-in for the few FreeRTOS definitions used by the platform independent modules, so that they can be built
+  by the native unit tests (pio test -e native). The tick count only moves when a test sets testTickCount, or when
+  vTaskDelay() is called: the delay advances it and returns immediately.
+*/
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY TickType_t(-1)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) TickType_t(uint64_t(ms) * configTICK_RATE_HZ / 1000)
+#define pdTRUE 1
+#define pdFALSE 0
+#define configASSERT(x) assert(x)
+
+inline TickType_t testTickCount = 0;
+inline TickType_t xTaskGetTickCount() { return testTickCount; }
+inline void vTaskDelay(TickType_t ticks) { testTickCount += ticks; }
+
+// the notifications of the current task, given by the test
+inline uint32_t testNotifications = 0;
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t) {
+  auto notifications = testNotifications;
+  testNotifications = clear ? 0 : notifications - !!notifications;
+  return notifications;
+}
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+// the tests are single threaded, mutexes always succeed
+struct StaticSemaphore_t {};
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+inline SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) { return buffer; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/*
+  Host stand-in for the FSP low power flash driver, backed by a RAM copy of the 8KB data flash. A location is blank
+  from the erase of its block until it is written, as on the RA4M1 the content of erased cells is not defined.
+  Journal.cpp picks up the address of the array through BLASTIC_DATA_FLASH_START.
+*/
+
+typedef int fsp_err_t;
+#define FSP_SUCCESS 0
+#define FSP_ERR_INVALID_ADDRESS 1
+typedef int IRQn_Type;
+#define FSP_INVALID_VECTOR ((IRQn_Type)-32)
+
+typedef enum { FLASH_RESULT_BLANK, FLASH_RESULT_NOT_BLANK, FLASH_RESULT_BGO_ACTIVE } flash_result_t;
+
+struct flash_cfg_t {
+  bool data_flash_bgo;
+  IRQn_Type irq;
+};
+
+struct flash_lp_instance_ctrl_t {
+  bool opened;
+};
+
+constexpr const size_t testDataFlashSize = 8 * 1024, testDataFlashBlockSize = 1024;
+inline uint8_t testDataFlash[testDataFlashSize];
+inline bool testDataFlashWritten[testDataFlashSize];
+
+#define BLASTIC_DATA_FLASH_START uintptr_t(testDataFlash)
+
+// erase the whole data flash, as on a new board
+inline void testDataFlashReset() {
+  memset(testDataFlash, 0xff, sizeof(testDataFlash));
+  memset(testDataFlashWritten, 0, sizeof(testDataFlashWritten));
+}
+
+inline bool testDataFlashRange(uintptr_t address, size_t size) {
+  return address >= uintptr_t(testDataFlash) && address + size <= uintptr_t(testDataFlash) + testDataFlashSize;
+}
+
+inline fsp_err_t R_FLASH_LP_Open(flash_lp_instance_ctrl_t *ctrl, const flash_cfg_t *) {
+  ctrl->opened = true;
+  return FSP_SUCCESS;
+}
+
+inline fsp_err_t R_FLASH_LP_Write(flash_lp_instance_ctrl_t *, uintptr_t source, uintptr_t address, uint32_t size) {
+  if (!testDataFlashRange(address, size)) return FSP_ERR_INVALID_ADDRESS;
+  auto offset = address - uintptr_t(testDataFlash);
+  memcpy(testDataFlash + offset, reinterpret_cast<const void *>(source), size);
+  memset(testDataFlashWritten + offset, true, size);
+  return FSP_SUCCESS;
+}
+
+inline fsp_err_t R_FLASH_LP_Erase(flash_lp_instance_ctrl_t *, uintptr_t address, uint32_t blocks) {
+  if (!testDataFlashRange(address, blocks * testDataFlashBlockSize)) return FSP_ERR_INVALID_ADDRESS;
+  auto offset = address - uintptr_t(testDataFlash);
+  memset(testDataFlash + offset, 0xff, blocks * testDataFlashBlockSize);
+  memset(testDataFlashWritten + offset, false, blocks * testDataFlashBlockSize);
+  return FSP_SUCCESS;
+}
+
+inline fsp_err_t R_FLASH_LP_BlankCheck(flash_lp_instance_ctrl_t *, uintptr_t address, uint32_t size,
+                                       flash_result_t *result) {
+  if (!testDataFlashRange(address, size)) return FSP_ERR_INVALID_ADDRESS;
+  auto offset = address - uintptr_t(testDataFlash);
+  *result = FLASH_RESULT_BLANK;
+  for (size_t i = 0; i < size; i++)
+    if (testDataFlashWritten[offset + i]) *result = FLASH_RESULT_NOT_BLANK;
+  return FSP_SUCCESS;
+}
@@ -0,0 +1,124 @@
+#include <cstring>
+#include <unity.h>
+#include "Backends.h"
+
+using namespace blastic::uploader;
+using blastic::journal::Submission;
+
+static char collectionPoint[128], collectorName[128];
+static const Identity identity{collectionPoint, collectorName, "blastic-scale/test"};
+static const FormBackend form(identity);
+static const BatchBackend batch(identity);
+static Endpoint formEndpoint, batchEndpoint;
+
+void setUp() {
+  strcpy(collectionPoint, "Aula 3/B");
+  strcpy(collectorName, "Maria & Paolo");
+  formEndpoint = {.backend = Endpoint::Backend::FORM,
+                  .urn = "docs.google.com/forms/d/e/x/formResponse",
+                  .form = {.type = "entry.1",
+                           .collectionPoint = "entry.2",
+                           .collectorName = "entry.4",
+                           .weight = "entry.3"},
+                  .batch = {}};
+  batchEndpoint = {.backend = Endpoint::Backend::BATCH,
+                   .urn = "example.com/submissions",
+                   .form = {},
+                   .batch = {.maxRecords = 4, .maxAge = 60}};
+}
+void tearDown() {}
+
+static Submission submission(uint32_t serial, bool thisBoot = true, uint32_t seconds = 100) {
+  return {.serial = serial, .plastic = uint8_t(serial % 7 + 1), .weight = 1.25f * serial, .seconds = seconds,
+          .thisBoot = thisBoot};
+}
+
+static void test_configured() {
+  TEST_ASSERT_TRUE(form.configured(formEndpoint));
+  TEST_ASSERT_TRUE(batch.configured(batchEndpoint));
+  formEndpoint.form.weight[0] = 0;
+  TEST_ASSERT_FALSE(form.configured(formEndpoint));
+  collectionPoint[0] = 0;
+  TEST_ASSERT_FALSE(batch.configured(batchEndpoint));
+}
+
+static void test_form_ready() {
+  uint32_t waitSeconds = 0;
+  TEST_ASSERT_EQUAL_size_t(0, form.ready(formEndpoint, 0, 0, false, waitSeconds));
+  TEST_ASSERT_EQUAL_size_t(1, form.ready(formEndpoint, 5, 0, false, waitSeconds));
+}
+
+// a batch goes out when maxRecords are pending, when the oldest is maxAge old, on flush, or right away after a reboot
+static void test_batch_ready() {
+  uint32_t waitSeconds = 0;
+  TEST_ASSERT_EQUAL_size_t(0, batch.ready(batchEndpoint, 3, 15, false, waitSeconds));
+  TEST_ASSERT_EQUAL_UINT32(45, waitSeconds);
+  TEST_ASSERT_EQUAL_size_t(4, batch.ready(batchEndpoint, 4, 0, false, waitSeconds));
+  TEST_ASSERT_EQUAL_size_t(4, batch.ready(batchEndpoint, 10, 0, false, waitSeconds));
+  TEST_ASSERT_EQUAL_size_t(2, batch.ready(batchEndpoint, 2, 60, false, waitSeconds));
+  TEST_ASSERT_EQUAL_size_t(3, batch.ready(batchEndpoint, 3, 0, true, waitSeconds));
+  TEST_ASSERT_EQUAL_size_t(1, batch.ready(batchEndpoint, 1, UINT32_MAX, false, waitSeconds));
+  // maxRecords is clamped to 1..maxBatch
+  batchEndpoint.batch.maxRecords = 0;
+  TEST_ASSERT_EQUAL_size_t(1, batch.ready(batchEndpoint, 3, 0, false, waitSeconds));
+  batchEndpoint.batch.maxRecords = 255;
+  TEST_ASSERT_EQUAL_size_t(maxBatch, batch.ready(batchEndpoint, 100, 0, true, waitSeconds));
+}
+
+static void test_form_encode() {
+  char buffer[256];
+  util::http::Writer body(buffer);
+  auto s = submission(1);
+  TEST_ASSERT_TRUE(form.encode(formEndpoint, &s, 1, 0, body));
+  TEST_ASSERT_EQUAL_STRING_LEN("entry.1=2+HDPE&entry.2=Aula%203%2FB&entry.3=1.25&entry.4=Maria%20%26%20Paolo",
+                               body.data(), body.length());
+  // without a collector name the device identifies itself
+  collectorName[0] = 0;
+  body.clear();
+  TEST_ASSERT_TRUE(form.encode(formEndpoint, &s, 1, 0, body));
+  TEST_ASSERT_EQUAL_STRING_LEN("entry.1=2+HDPE&entry.2=Aula%203%2FB&entry.3=1.25&entry.4=blastic-scale%2Ftest",
+                               body.data(), body.length());
+}
+
+static void test_batch_encode() {
+  char buffer[512];
+  util::http::Writer body(buffer);
+  Submission submissions[] = {submission(6, false), submission(7, true, 100)};
+  TEST_ASSERT_TRUE(batch.encode(batchEndpoint, submissions, 2, 140, body));
+  TEST_ASSERT_EQUAL_STRING_LEN("{\"device\":\"blastic-scale/test\",\"collectionPoint\":\"Aula 3/B\","
+                               "\"collector\":\"Maria & Paolo\"}\n"
+                               "{\"id\":6,\"plastic\":7,\"type\":\"Other\",\"weight\":7.500}\n"
+                               "{\"id\":7,\"plastic\":1,\"type\":\"Pet\",\"weight\":8.750,\"age\":40}\n",
+                               body.data(), body.length());
+}
+
+// a batch that does not fit in the body is halved, the rest goes in the next request
+static void test_halving() {
+  Submission submissions[maxBatch];
+  for (uint32_t i = 0; i < maxBatch; i++) submissions[i] = submission(i + 1);
+  char buffer[512];
+  util::http::Writer body(buffer);
+  // about 80 bytes for the first line and 60 per record
+  auto n = encodeFitting(batch, batchEndpoint, submissions, maxBatch, 200, body);
+  TEST_ASSERT_EQUAL_size_t(4, n);
+  TEST_ASSERT_TRUE(body.ok());
+  const char *last = body.data() + body.length() - 2;
+  while (last > body.data() && last[-1] != '\n') last--;
+  TEST_ASSERT_EQUAL_INT(0, strncmp(last, "{\"id\":4,", 8));
+  // nothing fits
+  char tiny[16];
+  util::http::Writer small(tiny);
+  TEST_ASSERT_EQUAL_size_t(0, encodeFitting(batch, batchEndpoint, submissions, maxBatch, 200, small));
+  TEST_ASSERT_EQUAL_size_t(0, encodeFitting(form, formEndpoint, submissions, 1, 200, small));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_configured);
+  RUN_TEST(test_form_ready);
+  RUN_TEST(test_batch_ready);
+  RUN_TEST(test_form_encode);
+  RUN_TEST(test_batch_encode);
+  RUN_TEST(test_halving);
+  return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "Checkweigher.h"
+
+using blastic::scale::Checkweigher;
+
+/*
+  Synthetic traces of items passing over the scale at the full output rate: a noisy baseline, then for each item a
+  linear rise, a plateau and a linear fall. The baseline drifts slowly between items.
+*/
+
+constexpr const Checkweigher::EEPROMConfig config{.trigger = 0.02, .plateauBand = 0.004, .minPlateauSamples = 5};
+
+static std::mt19937 generator;
+
+void setUp() { generator.seed(1); }
+void tearDown() {}
+
+struct Trace {
+  Checkweigher checkweigher;
+  std::vector<Checkweigher::Item> items;
+  std::normal_distribution<float> noise{0, 0.0005};
+  TickType_t tick = 0;
+
+  void feed(float weight) {
+    if (checkweigher.update(config, weight + noise(generator), tick)) items.push_back(checkweigher.item());
+    tick += 12;
+  }
+
+  void idle(float baseline, int samples) {
+    for (int i = 0; i < samples; i++) feed(baseline);
+  }
+
+  void item(float baseline, float weight, int ramp, int plateau) {
+    for (int i = 1; i <= ramp; i++) feed(baseline + weight * i / ramp);
+    for (int i = 0; i < plateau; i++) feed(baseline + weight);
+    for (int i = ramp - 1; i >= 0; i--) feed(baseline + weight * i / ramp);
+  }
+};
+
+static void test_items_on_drifting_baseline() {
+  std::uniform_real_distribution<float> weights(0.05, 0.25);
+  Trace trace;
+  std::vector<float> truth;
+  float baseline = 0.1;
+  trace.idle(baseline, 20);
+  for (int i = 0; i < 50; i++) {
+    truth.push_back(weights(generator));
+    trace.item(baseline, truth.back(), 5, 20);
+    trace.idle(baseline, 10);
+    baseline += 0.0005;
+  }
+  TEST_ASSERT_EQUAL_size_t(truth.size(), trace.items.size());
+  for (size_t i = 0; i < truth.size(); i++) {
+    auto &item = trace.items[i];
+    TEST_ASSERT_EQUAL_UINT32(i, item.sequence);
+    TEST_ASSERT_TRUE(item.stable);
+    TEST_ASSERT_TRUE(item.plateauSamples >= 15 && item.plateauSamples <= item.samples);
+    // the samples of the falling edge below the trigger pull the baseline up a little
+    TEST_ASSERT_FLOAT_WITHIN(0.002, truth[i], item.weight);
+    TEST_ASSERT_TRUE(item.end > item.start);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.002, baseline, trace.checkweigher.baseline());
+}
+
+// an item that bounces through without a plateau is reported, but not stable
+static void test_unstable_item() {
+  Trace trace;
+  trace.idle(0, 20);
+  trace.item(0, 0.1, 4, 0);
+  trace.idle(0, 10);
+  TEST_ASSERT_EQUAL_size_t(1, trace.items.size());
+  TEST_ASSERT_FALSE(trace.items[0].stable);
+  TEST_ASSERT_TRUE(trace.items[0].plateauSamples < config.minPlateauSamples);
+}
+
+// an item longer than capacity is weighed on the newest samples
+static void test_long_item() {
+  Trace trace;
+  trace.idle(0, 20);
+  trace.item(0, 0.2, 5, 3 * Checkweigher::capacity);
+  trace.idle(0, 10);
+  TEST_ASSERT_EQUAL_size_t(1, trace.items.size());
+  auto &item = trace.items[0];
+  TEST_ASSERT_TRUE(item.stable);
+  TEST_ASSERT_EQUAL_UINT16(3 * Checkweigher::capacity + 9, item.samples);
+  TEST_ASSERT_TRUE(item.plateauSamples <= Checkweigher::capacity);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.2, item.weight);
+}
+
+// an invalid reading drops the item in progress and the baseline
+static void test_nan_resets() {
+  Trace trace;
+  trace.idle(0, 20);
+  trace.idle(0.1, 10);
+  TEST_ASSERT_TRUE(trace.checkweigher.inItem());
+  trace.feed(NAN);
+  TEST_ASSERT_FALSE(trace.checkweigher.inItem());
+  trace.idle(0.1, 10);
+  TEST_ASSERT_TRUE(trace.items.empty());
+  TEST_ASSERT_FLOAT_WITHIN(0.002, 0.1, trace.checkweigher.baseline());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_items_on_drifting_baseline);
+  RUN_TEST(test_unstable_item);
+  RUN_TEST(test_long_item);
+  RUN_TEST(test_nan_resets);
+  return UNITY_END();
+}
@@ -0,0 +1,206 @@
+#include <string>
+#include <vector>
+#include <r_flash_lp.h>
+#include <unity.h>
+#include "Fanout.h"
+
+using namespace blastic::uploader;
+namespace journal = blastic::journal;
+
+/*
+  Stand-in server on the other end of a transport: it answers each complete request (head and Content-Length body)
+  with response, delay ticks after receiving it. The ticks only move when the fan-out waits in vTaskDelay(), so the
+  test runs at full speed and sees the same interleaving as the board.
+*/
+class Server : public Transport {
+  std::string received, pending;
+  TickType_t readyTick = 0;
+  bool open = false;
+
+public:
+  const char *response;
+  TickType_t delay;
+  // the connection looks open, but the first write fails (closed by the server while idle)
+  bool stale = false;
+  size_t connects = 0;
+  std::vector<std::string> bodies;
+  std::vector<TickType_t> requestTicks;
+
+  Server(const char *response, TickType_t delay = 0) : response(response), delay(delay) {}
+
+  bool connect(const char *, uint16_t) override {
+    connects++, open = true, received.clear(), pending.clear();
+    return true;
+  }
+  bool connected() override { return open; }
+  size_t write(const uint8_t *data, size_t size) override {
+    if (stale) stale = open = false;
+    if (!open) return 0;
+    received.append(reinterpret_cast<const char *>(data), size);
+    auto headEnd = received.find("\r\n\r\n");
+    auto lengthStart = received.find("Content-Length: ");
+    if (headEnd == std::string::npos || lengthStart == std::string::npos) return size;
+    auto length = std::stoul(received.substr(lengthStart + 16));
+    if (received.size() < headEnd + 4 + length) return size;
+    bodies.push_back(received.substr(headEnd + 4, length));
+    requestTicks.push_back(xTaskGetTickCount());
+    received.erase(0, headEnd + 4 + length);
+    pending += response, readyTick = xTaskGetTickCount() + delay;
+    return size;
+  }
+  int read(uint8_t *data, size_t size) override {
+    if (!open) return -1;
+    if (pending.empty() || int32_t(xTaskGetTickCount() - readyTick) < 0) return 0;
+    size = std::min(size, pending.size());
+    memcpy(data, pending.data(), size);
+    pending.erase(0, size);
+    return size;
+  }
+  void stop() override { open = false; }
+};
+
+static const char ok[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok",
+                  unavailable[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n",
+                  badRequest[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+
+static char collectionPoint[] = "Aula 3", collectorName[] = "";
+static const Identity identity{collectionPoint, collectorName, "blastic-scale/test"};
+static Endpoint endpoints[journal::maxEndpoints];
+
+void setUp() {
+  testTickCount = 0, testNotifications = 0;
+  testDataFlashReset();
+  TEST_ASSERT_TRUE(journal::begin());
+  journal::endpoints(0b111);
+  endpoints[0] = {.backend = Endpoint::Backend::FORM,
+                  .urn = "fast.example.com/form",
+                  .form = {.type = "t", .collectionPoint = "c", .collectorName = "n", .weight = "w"},
+                  .batch = {}};
+  endpoints[1] = {.backend = Endpoint::Backend::BATCH,
+                  .urn = "slow.example.com/batch",
+                  .form = {},
+                  .batch = {.maxRecords = 8, .maxAge = 60}};
+  endpoints[2] = endpoints[0];
+  strcpy(endpoints[2].urn, "failing.example.com/form");
+}
+void tearDown() {}
+
+static void appendSome(size_t n) {
+  for (size_t i = 0; i < n; i++) TEST_ASSERT_NOT_EQUAL(0, journal::append(i % 7 + 1, 0.5f + i));
+}
+
+/*
+  One endpoint answers at once, one takes two seconds, one fails: the fast endpoint delivers all its submissions while
+  the slow one is still waiting, and the failing one is scheduled for a retry without holding up the others.
+*/
+static void test_slow_failing_ok() {
+  Server fast(ok), slow(ok, 2000), failing(unavailable);
+  Transport *const transports[]{&fast, &slow, &failing};
+  Fanout fanout(endpoints, identity, transports);
+  appendSome(3);
+  fanout.flush();
+  auto wanting = fanout.due(true);
+  TEST_ASSERT_EQUAL_UINT(0b111, wanting);
+  fanout.deliver(wanting);
+
+  TEST_ASSERT_EQUAL_size_t(3, fast.bodies.size());
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(0));
+  TEST_ASSERT_EQUAL_UINT32(3, fanout.stats(0).uploaded);
+  // one handshake, then the connection is reused
+  TEST_ASSERT_EQUAL_UINT32(1, fanout.stats(0).handshakes);
+  TEST_ASSERT_EQUAL_UINT32(2, fanout.stats(0).reuses);
+  TEST_ASSERT_LESS_THAN(slow.requestTicks[0] + slow.delay, fast.requestTicks.back());
+
+  // the batch goes out in a single request, and deliver() returns only when its response is in
+  TEST_ASSERT_EQUAL_size_t(1, slow.bodies.size());
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(1));
+  TEST_ASSERT_EQUAL_UINT32(3, fanout.stats(1).uploaded);
+  TEST_ASSERT_GREATER_OR_EQUAL(slow.delay, xTaskGetTickCount());
+
+  TEST_ASSERT_EQUAL_size_t(1, failing.bodies.size());
+  TEST_ASSERT_EQUAL_size_t(3, journal::pending(2));
+  auto stats = fanout.stats(2);
+  TEST_ASSERT_EQUAL_INT(503, stats.lastStatus);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.failures);
+  TEST_ASSERT_EQUAL_UINT32(minBackoff, stats.backoff);
+
+  // the failing endpoint is checked again after the backoff, and only that one
+  TEST_ASSERT_LESS_OR_EQUAL(minBackoff * configTICK_RATE_HZ, fanout.nextCheck());
+  testTickCount += fanout.nextCheck();
+  failing.response = ok;
+  wanting = fanout.due(false);
+  TEST_ASSERT_EQUAL_UINT(0b100, wanting);
+  fanout.deliver(wanting);
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(2));
+  TEST_ASSERT_EQUAL_UINT32(0, fanout.stats(2).backoff);
+  TEST_ASSERT_EQUAL_size_t(3, fast.bodies.size());
+}
+
+// a 4xx that retrying cannot fix drops the submission, so that it does not block the ones after it
+static void test_permanent_error() {
+  Server fast(ok), slow(ok), rejecting(badRequest);
+  Transport *const transports[]{&fast, &slow, &rejecting};
+  Fanout fanout(endpoints, identity, transports);
+  appendSome(2);
+  fanout.deliver(fanout.due(true));
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(2));
+  TEST_ASSERT_EQUAL_UINT32(2, fanout.stats(2).dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, fanout.stats(2).failures);
+  // the batch endpoint waits for more records
+  TEST_ASSERT_EQUAL_size_t(2, journal::pending(1));
+  TEST_ASSERT_EQUAL_size_t(0, slow.bodies.size());
+}
+
+// a server that never answers fails the request after the response timeout, the others go on
+static void test_response_timeout() {
+  Server fast(ok), silent(""), failing(unavailable);
+  Transport *const transports[]{&fast, &silent, &failing};
+  Fanout fanout(endpoints, identity, transports);
+  appendSome(1);
+  fanout.flush();
+  fanout.deliver(fanout.due(true));
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(0));
+  TEST_ASSERT_EQUAL_size_t(1, journal::pending(1));
+  TEST_ASSERT_EQUAL_INT(responseError, fanout.stats(1).lastStatus);
+  TEST_ASSERT_GREATER_OR_EQUAL(30000, xTaskGetTickCount());
+  TEST_ASSERT_FALSE(silent.connected());
+}
+
+// an idle connection closed by the server is found out on the first write, and the request is sent on a new one
+static void test_stale_connection() {
+  Server fast(ok), slow(ok), failing(ok);
+  Transport *const transports[]{&fast, &slow, &failing};
+  Fanout fanout(endpoints, identity, transports);
+  fanout.warmUp();
+  TEST_ASSERT_EQUAL_size_t(1, fast.connects);
+  fast.stale = true;
+  appendSome(1);
+  fanout.deliver(fanout.due(true));
+  TEST_ASSERT_EQUAL_size_t(2, fast.connects);
+  TEST_ASSERT_EQUAL_size_t(1, fast.bodies.size());
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(0));
+  TEST_ASSERT_EQUAL_UINT32(0, fanout.stats(0).failures);
+}
+
+// without WiFi, all the due endpoints back off
+static void test_no_wifi() {
+  Server fast(ok), slow(ok), failing(ok);
+  Transport *const transports[]{&fast, &slow, &failing};
+  Fanout fanout(endpoints, identity, transports);
+  appendSome(1);
+  fanout.fail(fanout.due(true), wifiError);
+  TEST_ASSERT_EQUAL_INT(wifiError, fanout.stats(0).lastStatus);
+  TEST_ASSERT_EQUAL_INT(wifiError, fanout.stats(2).lastStatus);
+  TEST_ASSERT_EQUAL_UINT32(minBackoff, fanout.stats(2).backoff);
+  TEST_ASSERT_EQUAL_size_t(0, fast.connects);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_slow_failing_ok);
+  RUN_TEST(test_permanent_error);
+  RUN_TEST(test_response_timeout);
+  RUN_TEST(test_stale_connection);
+  RUN_TEST(test_no_wifi);
+  return UNITY_END();
+}
@@ -0,0 +1,371 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "Http.h"
+
+using util::http::ResponseParser;
+using util::http::Writer;
+
+// heap allocations through new, counted only while measuring
+static bool countingNew = false;
+static size_t newCount = 0;
+
+void *operator new(size_t size) {
+  newCount += countingNew;
+  if (auto p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+// not inlined, or GCC sees free() on the result of operator new and warns
+[[gnu::noinline]] void operator delete(void *p) noexcept { free(p); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept { free(p); }
+
+void setUp() {}
+void tearDown() {}
+
+struct Parsed {
+  ResponseParser parser;
+  std::vector<std::string> headers;
+  std::string body;
+  size_t consumed = 0;
+};
+
+// feed the response in chunks of step bytes, as they may come from the socket
+static Parsed parse(const char *response, size_t step) {
+  Parsed parsed;
+  auto &parser = parsed.parser;
+  auto size = strlen(response);
+  while (parsed.consumed < size && !parser.done() && !parser.error())
+    parsed.consumed += parser.feed(
+        reinterpret_cast<const uint8_t *>(response) + parsed.consumed, std::min(step, size - parsed.consumed),
+        [&](const char *name, const char *value) { parsed.headers.push_back(std::string(name) + "=" + value); },
+        [&](const uint8_t *data, size_t size) { parsed.body.append(reinterpret_cast<const char *>(data), size); });
+  return parsed;
+}
+
+static const size_t steps[] = {1, 2, 3, 7, 1000};
+
+static void test_content_length() {
+  const char response[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 5\r\n\r\nhelloEXTRA";
+  for (auto step : steps) {
+    auto parsed = parse(response, step);
+    TEST_ASSERT_TRUE(parsed.parser.done());
+    TEST_ASSERT_EQUAL_INT(200, parsed.parser.status());
+    TEST_ASSERT_FALSE(parsed.parser.mustClose());
+    TEST_ASSERT_EQUAL_STRING("hello", parsed.body.c_str());
+    // the bytes after the body belong to the next response
+    TEST_ASSERT_EQUAL_size_t(strlen(response) - 5, parsed.consumed);
+    TEST_ASSERT_EQUAL_size_t(2, parsed.headers.size());
+    TEST_ASSERT_EQUAL_STRING("Content-Type=text/html", parsed.headers[0].c_str());
+  }
+}
+
+static void test_chunked_after_continue() {
+  const char response[] = "HTTP/1.1 100 Continue\r\n\r\n"
+                          "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+                          "3;x=1\r\nabc\r\n2\r\nde\r\n0\r\nT: 1\r\n\r\n";
+  for (auto step : steps) {
+    auto parsed = parse(response, step);
+    TEST_ASSERT_TRUE(parsed.parser.done());
+    TEST_ASSERT_EQUAL_INT(200, parsed.parser.status());
+    TEST_ASSERT_TRUE(parsed.parser.mustClose());
+    TEST_ASSERT_EQUAL_STRING("abcde", parsed.body.c_str());
+    TEST_ASSERT_EQUAL_size_t(strlen(response), parsed.consumed);
+  }
+}
+
+// status and header lines may be split anywhere, also between \r and \n
+static void test_split_lines() {
+  const char response[] = "HTTP/1.1 201 Created\r\nX-Long: " // truncated to maxLine
+                          "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890"
+                          "\r\nContent-Length: 2\n\r\nok";
+  for (auto step : steps) {
+    auto parsed = parse(response, step);
+    TEST_ASSERT_TRUE(parsed.parser.done());
+    TEST_ASSERT_EQUAL_INT(201, parsed.parser.status());
+    TEST_ASSERT_EQUAL_STRING("ok", parsed.body.c_str());
+    TEST_ASSERT_EQUAL_size_t(2, parsed.headers.size());
+    // the line keeps maxLine - 1 characters, "name=value" loses the space after the colon
+    TEST_ASSERT_EQUAL_size_t(ResponseParser::maxLine - 2, parsed.headers[0].size());
+  }
+}
+
+static void test_close_delimited() {
+  const char response[] = "HTTP/1.0 302 Found\r\nLocation: x\r\n\r\nstuff";
+  for (auto step : steps) {
+    auto parsed = parse(response, step);
+    TEST_ASSERT_FALSE(parsed.parser.done());
+    TEST_ASSERT_FALSE(parsed.parser.error());
+    TEST_ASSERT_TRUE(parsed.parser.closeDelimited());
+    TEST_ASSERT_TRUE(parsed.parser.mustClose());
+    TEST_ASSERT_EQUAL_INT(302, parsed.parser.status());
+    TEST_ASSERT_EQUAL_STRING("stuff", parsed.body.c_str());
+  }
+}
+
+static void test_no_body() {
+  for (auto response : {"HTTP/1.1 204 No Content\r\n\r\n", "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"}) {
+    auto parsed = parse(response, 1);
+    TEST_ASSERT_TRUE(parsed.parser.done());
+    TEST_ASSERT_TRUE(parsed.body.empty());
+  }
+}
+
+static void test_garbage() {
+  for (auto response : {"garbage\r\n", "HTTP/1.1 2x0 OK\r\n\r\n", "HTTP/1.1 200 OK\r\nContent-Length: x\r\n\r\n",
+                        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+                        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabX\r\n"})
+    for (auto step : steps) {
+      auto parsed = parse(response, step);
+      TEST_ASSERT_TRUE_MESSAGE(parsed.parser.error(), response);
+      TEST_ASSERT_FALSE(parsed.parser.done());
+    }
+}
+
+static void test_writer() {
+  char buffer[128];
+  Writer writer(buffer);
+  writer.raw("a=").urlEncoded("x y&z/\xc3\xa9").raw('&').decimal(1.5f).raw(' ').decimal(0.049f).raw(' ');
+  writer.decimal(12.005f, 3).raw(' ').decimal(-2.5f, 0).raw(' ').number(0).raw(' ').number(4294967295u);
+  TEST_ASSERT_TRUE(writer.ok());
+  TEST_ASSERT_EQUAL_STRING_LEN("a=x%20y%26z%2F%C3%A9&1.50 0.05 12.005 -3 0 4294967295", writer.data(),
+                               writer.length());
+  writer.clear();
+  writer.jsonString("a\"b\\c\n");
+  TEST_ASSERT_EQUAL_STRING_LEN("\"a\\\"b\\\\c\\u000a\"", writer.data(), writer.length());
+}
+
+static void test_writer_overflow() {
+  char small[4];
+  Writer writer(small);
+  writer.raw("hello");
+  TEST_ASSERT_FALSE(writer.ok());
+  TEST_ASSERT_EQUAL_size_t(4, writer.length());
+  writer.clear();
+  TEST_ASSERT_TRUE(writer.raw("abc").ok());
+}
+
+/*
+  Host stand-in of the path replaced by Writer and ResponseParser, reproducing only its allocations and copies: the
+  Arduino String (reserve() reallocates to the exact length), URLEncoder.encode() returning a String, and
+  ArduinoHttpClient, that prints the request on the client piece by piece and reads the response headers one byte at a
+  time into a String, then splits each line with substring().
+*/
+static struct {
+  size_t allocations, copied, clientCalls;
+} legacy;
+
+class LegacyString {
+  char *buffer = nullptr;
+  size_t len = 0, capacity = 0;
+
+public:
+  LegacyString() = default;
+  LegacyString(const char *s, size_t n) { concat(s, n); }
+  LegacyString(LegacyString &&o) : buffer(o.buffer), len(o.len), capacity(o.capacity) {
+    o.buffer = nullptr, o.len = o.capacity = 0;
+  }
+  LegacyString(const LegacyString &) = delete;
+  ~LegacyString() { free(buffer); }
+
+  const char *c_str() const { return buffer ? buffer : ""; }
+  size_t length() const { return len; }
+  void clear() { len = 0; }
+
+  void reserve(size_t size) {
+    if (buffer && capacity >= size) return;
+    // realloc moves the content in the worst case
+    buffer = static_cast<char *>(realloc(buffer, size + 1));
+    legacy.allocations++, legacy.copied += len, capacity = size;
+  }
+  LegacyString &concat(const char *s, size_t n) {
+    reserve(len + n);
+    memcpy(buffer + len, s, n);
+    len += n, buffer[len] = 0, legacy.copied += n;
+    return *this;
+  }
+  LegacyString &operator+=(const char *s) { return concat(s, strlen(s)); }
+  LegacyString &operator+=(const LegacyString &s) { return concat(s.c_str(), s.len); }
+  LegacyString &operator+=(char c) { return concat(&c, 1); }
+  // the numbers are formatted in a stack buffer, as String::concat(float) with dtostrf(value, 4, 2)
+  LegacyString &operator+=(unsigned n) {
+    char digits[12];
+    return concat(digits, snprintf(digits, sizeof(digits), "%u", n));
+  }
+  LegacyString &operator+=(float f) {
+    char digits[20];
+    return concat(digits, snprintf(digits, sizeof(digits), "%4.2f", f));
+  }
+  LegacyString substring(size_t from, size_t to) const { return LegacyString(buffer + from, to - from); }
+};
+
+static LegacyString legacyUrlEncode(const char *s) {
+  constexpr const char hex[] = "0123456789ABCDEF";
+  LegacyString encoded;
+  encoded.reserve(strlen(s));
+  for (; *s; s++) {
+    char c = *s;
+    if (isalnum(uint8_t(c)) || c == '-' || c == '.' || c == '_' || c == '~') encoded += c;
+    else {
+      char escaped[] = {'%', hex[uint8_t(c) >> 4], hex[uint8_t(c) & 0xf], 0};
+      encoded += escaped;
+    }
+  }
+  return encoded;
+}
+
+// the socket, each print is a write to the modem
+struct LegacyClient {
+  std::string sent;
+  const char *response;
+  size_t responseSize, position = 0;
+  void print(const char *s) { sent += s, legacy.clientCalls++; }
+  void print(const LegacyString &s) { print(s.c_str()); }
+  void println(const char *s) { print(s), print("\r\n"); }
+  void println(unsigned n) { println(std::to_string(n).c_str()); }
+  int read() { return legacy.clientCalls++, position < responseSize ? uint8_t(response[position++]) : -1; }
+};
+
+struct Submission {
+  uint8_t plastic;
+  float weight;
+};
+
+static const char *const plasticNames[] = {"PET", "HDPE", "PVC", "LDPE", "PP", "PS", "OTHER"};
+static const char collectionPoint[] = "Liceo Scientifico, aula 3/B", collectorName[] = "Maria & Paolo";
+static const char userAgent[] = "blastic-scale/0123456789abcdef";
+static const char response[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+                               "Cache-Control: no-cache, no-store, max-age=0, must-revalidate\r\n"
+                               "Date: Sun, 18 Oct 2026 10:00:00 GMT\r\nServer: GSE\r\nContent-Length: 2\r\n"
+                               "Connection: keep-alive\r\n\r\nok";
+
+static int legacySubmit(LegacyClient &client, const Submission &submission) {
+  LegacyString formData;
+  formData += "entry.1=";
+  formData += unsigned(submission.plastic);
+  formData += '+';
+  formData += plasticNames[submission.plastic];
+  formData += "&entry.2=";
+  formData += legacyUrlEncode(collectionPoint);
+  formData += "&entry.3=";
+  formData += submission.weight;
+  formData += "&entry.4=";
+  formData += legacyUrlEncode(collectorName);
+  client.print("POST "), client.print("/forms/d/e/x/formResponse"), client.println(" HTTP/1.1");
+  for (auto header : {"Host", "User-Agent", "Content-Type", "Content-Length", "Accept"}) {
+    client.print(header), client.print(": ");
+    if (!strcmp(header, "Host")) client.println("docs.google.com");
+    else if (!strcmp(header, "User-Agent")) client.println(userAgent);
+    else if (!strcmp(header, "Content-Type")) client.println("application/x-www-form-urlencoded");
+    else if (!strcmp(header, "Content-Length")) client.println(unsigned(formData.length()));
+    else client.println("*/*");
+  }
+  client.println("");
+  client.print(formData);
+  // status line, then the header lines one byte at a time, as HttpClient::headerAvailable()
+  int status = 0, c;
+  for (int i = 0; (c = client.read()) != '\n' && c >= 0; i++)
+    if (i >= 9 && i < 12) status = status * 10 + c - '0';
+  LegacyString line;
+  while (true) {
+    line.clear();
+    while ((c = client.read()) >= 0 && c != '\n')
+      if (c != '\r') line += char(c);
+    if (!line.length()) break;
+    auto colon = strchr(line.c_str(), ':') - line.c_str();
+    auto name = line.substring(0, colon), value = line.substring(colon + 2, line.length());
+  }
+  // the body
+  while (client.read() >= 0) {}
+  return status;
+}
+
+// the new path copies the request into the two buffers, and the response into the chunk and the header lines
+static struct {
+  size_t copied, clientCalls;
+} current;
+
+static int submit(std::string &sent, const Submission &submission) {
+  char bodyBuffer[2048], head[384];
+  Writer body(bodyBuffer), request(head);
+  body.raw("entry.1=").number(submission.plastic).raw('+').raw(plasticNames[submission.plastic]);
+  body.raw("&entry.2=").urlEncoded(collectionPoint);
+  body.raw("&entry.3=").decimal(submission.weight);
+  body.raw("&entry.4=").urlEncoded(collectorName);
+  request.raw("POST /forms/d/e/x/formResponse HTTP/1.1\r\nHost: docs.google.com\r\nUser-Agent: ").raw(userAgent);
+  request.raw("\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: ").number(body.length());
+  request.raw("\r\nAccept: */*\r\n\r\n");
+  TEST_ASSERT_TRUE(body.ok() && request.ok());
+  sent.append(request.data(), request.length()).append(body.data(), body.length());
+  current.copied += request.length() + body.length(), current.clientCalls += 2;
+  // the response read in chunks, as the uploader does
+  ResponseParser parser;
+  for (size_t position = 0; position < sizeof(response) - 1 && !parser.done();) {
+    uint8_t chunk[128];
+    auto len = std::min(sizeof(chunk), sizeof(response) - 1 - position);
+    memcpy(chunk, response + position, len);
+    current.copied += len, current.clientCalls++;
+    position += parser.feed(chunk, len, [](const char *, const char *) {}, [](const uint8_t *, size_t) {});
+  }
+  current.copied += strstr(response, "\r\n\r\n") - response;
+  return parser.status();
+}
+
+// allocations, bytes copied and client calls per submission of a form, old path against Writer and ResponseParser
+static void test_benchmark() {
+  using clock = std::chrono::steady_clock;
+  constexpr const size_t submissions = 10000;
+  std::vector<Submission> stream(submissions);
+  for (size_t i = 0; i < submissions; i++) stream[i] = {uint8_t(i % 7), float(i % 1000) / 100 + 0.123f};
+  std::string legacySent, sent;
+  legacySent.reserve(1024), sent.reserve(1024);
+  legacy = {};
+  auto start = clock::now();
+  for (auto &submission : stream) {
+    legacySent.clear();
+    LegacyClient client{.sent = std::move(legacySent), .response = response, .responseSize = sizeof(response) - 1};
+    TEST_ASSERT_EQUAL_INT(200, legacySubmit(client, submission));
+    legacySent = std::move(client.sent);
+  }
+  auto legacyTime = clock::now() - start;
+  current = {}, newCount = 0, countingNew = true;
+  start = clock::now();
+  for (auto &submission : stream) {
+    sent.clear();
+    TEST_ASSERT_EQUAL_INT(200, submit(sent, submission));
+  }
+  auto time = clock::now() - start;
+  countingNew = false;
+  // same bytes on the wire, but for the header order
+  auto legacyBody = legacySent.substr(legacySent.find("\r\n\r\n")), body = sent.substr(sent.find("\r\n\r\n"));
+  TEST_ASSERT_EQUAL_STRING(legacyBody.c_str(), body.c_str());
+  TEST_ASSERT_EQUAL_size_t(legacySent.size(), sent.size());
+  TEST_ASSERT_EQUAL_size_t(0, newCount);
+  char message[192];
+  snprintf(message, sizeof(message),
+           "per submission: String path %.1f allocations, %.0f bytes copied, %.0f client calls, %.0f ns; "
+           "Writer %zu allocations, %.0f bytes copied, %.0f client calls, %.0f ns",
+           double(legacy.allocations) / submissions, double(legacy.copied) / submissions,
+           double(legacy.clientCalls) / submissions,
+           std::chrono::duration<double, std::nano>(legacyTime).count() / submissions,
+           newCount, double(current.copied) / submissions, double(current.clientCalls) / submissions,
+           std::chrono::duration<double, std::nano>(time).count() / submissions);
+  TEST_MESSAGE(message);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_content_length);
+  RUN_TEST(test_chunked_after_continue);
+  RUN_TEST(test_split_lines);
+  RUN_TEST(test_close_delimited);
+  RUN_TEST(test_no_body);
+  RUN_TEST(test_garbage);
+  RUN_TEST(test_writer);
+  RUN_TEST(test_writer_overflow);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
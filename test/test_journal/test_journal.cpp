@@ -0,0 +1,96 @@
+#include <r_flash_lp.h>
+#include <unity.h>
+#include "Journal.h"
+
+namespace journal = blastic::journal;
+
+/*
+  Delivery to two endpoints, where endpoint 0 succeeds and endpoint 1 keeps failing: each endpoint must see its own
+  cursor, in memory and after a reboot (a new scan of the data flash), and the failing one must hold back the reuse of
+  the flash until it catches up or is disabled.
+*/
+
+void setUp() {
+  testDataFlashReset();
+  TEST_ASSERT_TRUE(journal::begin());
+  journal::endpoints(0b011);
+}
+void tearDown() {}
+
+static uint32_t appendSome(size_t n) {
+  uint32_t serial = 0;
+  for (size_t i = 0; i < n; i++) {
+    serial = journal::append(i % 7, 0.5f + i);
+    TEST_ASSERT_NOT_EQUAL(0, serial);
+  }
+  return serial;
+}
+
+// serial of the oldest submission not acked by endpoint, 0 if none
+static uint32_t frontSerial(uint8_t endpoint) {
+  journal::Submission submission;
+  return journal::front(endpoint, &submission, 1) ? submission.serial : 0;
+}
+
+static void test_independent_cursors() {
+  auto last = appendSome(5);
+  journal::Submission submissions[8];
+  TEST_ASSERT_EQUAL_size_t(5, journal::front(0, submissions, 8));
+  TEST_ASSERT_EQUAL_size_t(5, journal::front(1, submissions, 8));
+  auto first = submissions[0].serial;
+  TEST_ASSERT_TRUE(submissions[0].thisBoot);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, submissions[0].weight);
+
+  // endpoint 0 delivers everything, endpoint 1 fails and acks nothing
+  TEST_ASSERT_TRUE(journal::ack(0, last));
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(0));
+  TEST_ASSERT_EQUAL_UINT32(0, frontSerial(0));
+  TEST_ASSERT_EQUAL_size_t(5, journal::pending(1));
+  TEST_ASSERT_EQUAL_UINT32(first, frontSerial(1));
+  TEST_ASSERT_EQUAL_size_t(5, journal::stats().pending);
+
+  // the cursors survive a reboot
+  TEST_ASSERT_TRUE(journal::begin());
+  journal::endpoints(0b011);
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(0));
+  TEST_ASSERT_EQUAL_size_t(5, journal::pending(1));
+  TEST_ASSERT_EQUAL_UINT32(first, frontSerial(1));
+  TEST_ASSERT_FALSE(journal::front(1, submissions, 1) && submissions[0].thisBoot);
+
+  // endpoint 1 recovers and delivers part of the backlog, a new submission is pending for both
+  TEST_ASSERT_TRUE(journal::ack(1, first + 1));
+  TEST_ASSERT_EQUAL_size_t(3, journal::pending(1));
+  TEST_ASSERT_EQUAL_UINT32(first + 2, frontSerial(1));
+  auto next = appendSome(1);
+  TEST_ASSERT_EQUAL_UINT32(next, frontSerial(0));
+  TEST_ASSERT_EQUAL_size_t(4, journal::pending(1));
+  TEST_ASSERT_EQUAL_size_t(4, journal::stats().pending);
+}
+
+static void test_failing_endpoint_holds_the_flash() {
+  // endpoint 0 acks each submission, endpoint 1 never does, until the ring is full
+  size_t appended = 0;
+  for (uint32_t serial; (serial = journal::append(1, 1)); appended++) TEST_ASSERT_TRUE(journal::ack(0, serial));
+  // the submission and the ack take a 16 byte record each
+  TEST_ASSERT_EQUAL_size_t(testDataFlashSize / 16 / 2, appended);
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(0));
+  TEST_ASSERT_EQUAL_size_t(appended, journal::pending(1));
+  TEST_ASSERT_EQUAL_UINT32(0, journal::stats().writeErrors);
+
+  // disabling endpoint 1 releases the blocks, enabling it again skips what it missed
+  journal::endpoints(0b001);
+  TEST_ASSERT_EQUAL_size_t(0, journal::stats().pending);
+  auto serial = journal::append(1, 1);
+  TEST_ASSERT_NOT_EQUAL(0, serial);
+  journal::endpoints(0b011);
+  TEST_ASSERT_EQUAL_size_t(0, journal::pending(1));
+  TEST_ASSERT_EQUAL_size_t(1, journal::pending(0));
+  TEST_ASSERT_EQUAL_UINT32(serial, frontSerial(0));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_independent_cursors);
+  RUN_TEST(test_failing_endpoint_holds_the_flash);
+  return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "MedianFilter.h"
+
+using blastic::scale::MedianFilter;
+
+constexpr const size_t capacity = 64;
+
+static std::mt19937 generator;
+
+void setUp() { generator.seed(1); }
+void tearDown() {}
+
+// the path replaced by the filter: copy the window and sort it at each read
+template <typename T> static T sortedMedian(std::vector<T> window) {
+  std::sort(window.begin(), window.end());
+  auto size = window.size();
+  return size % 2 ? window[size / 2] : (window[size / 2 - 1] + window[size / 2]) / 2;
+}
+
+template <typename T> static T sortedTrimmedMean(std::vector<T> window, size_t trim) {
+  std::sort(window.begin(), window.end());
+  int64_t sum = 0;
+  for (auto i = trim; i < window.size() - trim; i++) sum += window[i];
+  return T(sum / int64_t(window.size() - 2 * trim));
+}
+
+static void test_median_matches_sort() {
+  std::uniform_int_distribution<int32_t> values(-(1 << 23), (1 << 23) - 1);
+  MedianFilter<int32_t, capacity> filter;
+  for (size_t width : {size_t(1), size_t(2), size_t(3), size_t(8), size_t(31), capacity}) {
+    filter.reset(width);
+    std::vector<int32_t> window;
+    for (int i = 0; i < 1000; i++) {
+      auto value = values(generator);
+      filter.push(value);
+      window.push_back(value);
+      if (window.size() > width) window.erase(window.begin());
+      TEST_ASSERT_EQUAL_size_t(window.size(), filter.count());
+      TEST_ASSERT_EQUAL_INT32(sortedMedian(window), filter.median());
+      for (size_t j = 0; j < window.size(); j++) TEST_ASSERT_EQUAL_INT32(window[j], filter[j]);
+    }
+  }
+}
+
+static void test_trimmed_mean_matches_sort() {
+  std::uniform_int_distribution<int32_t> values(-(1 << 23), (1 << 23) - 1);
+  MedianFilter<int32_t, capacity> filter(16);
+  std::vector<int32_t> window;
+  for (int i = 0; i < 1000; i++) {
+    auto value = values(generator);
+    filter.push(value);
+    window.push_back(value);
+    if (window.size() > 16) window.erase(window.begin());
+    for (size_t trim = 0; 2 * trim < window.size(); trim++)
+      TEST_ASSERT_EQUAL_INT32(sortedTrimmedMean(window, trim), filter.trimmedMean(trim));
+  }
+}
+
+// many equal values stress the eviction of the right duplicate
+static void test_duplicates() {
+  std::uniform_int_distribution<int32_t> values(0, 3);
+  MedianFilter<int32_t, capacity> filter(7);
+  std::vector<int32_t> window;
+  for (int i = 0; i < 1000; i++) {
+    auto value = values(generator);
+    filter.push(value);
+    window.push_back(value);
+    if (window.size() > 7) window.erase(window.begin());
+    TEST_ASSERT_EQUAL_INT32(sortedMedian(window), filter.median());
+  }
+}
+
+static void test_float() {
+  std::normal_distribution<float> values(1.5, 0.01);
+  MedianFilter<float, capacity> filter(9);
+  std::vector<float> window;
+  for (int i = 0; i < 1000; i++) {
+    auto value = values(generator);
+    filter.push(value);
+    window.push_back(value);
+    if (window.size() > 9) window.erase(window.begin());
+    TEST_ASSERT_EQUAL_FLOAT(sortedMedian(window), filter.median());
+  }
+}
+
+// time per sample of a running median over a stream, filter against copy and sort
+static void test_benchmark() {
+  using clock = std::chrono::steady_clock;
+  constexpr const size_t samples = 200000;
+  std::uniform_int_distribution<int32_t> values(-(1 << 23), (1 << 23) - 1);
+  std::vector<int32_t> stream(samples);
+  for (auto &value : stream) value = values(generator);
+  for (size_t width : {size_t(5), size_t(15), capacity}) {
+    int64_t checksum[2] = {};
+    MedianFilter<int32_t, capacity> filter(width);
+    auto start = clock::now();
+    for (auto value : stream) {
+      filter.push(value);
+      checksum[0] += filter.median();
+    }
+    auto filterTime = clock::now() - start;
+    std::vector<int32_t> window;
+    start = clock::now();
+    for (auto value : stream) {
+      window.push_back(value);
+      if (window.size() > width) window.erase(window.begin());
+      checksum[1] += sortedMedian(window);
+    }
+    auto sortTime = clock::now() - start;
+    TEST_ASSERT_TRUE(checksum[0] == checksum[1]);
+    char message[128];
+    snprintf(message, sizeof(message), "width %zu: filter %.1f ns/sample, copy and sort %.1f ns/sample", width,
+             std::chrono::duration<double, std::nano>(filterTime).count() / samples,
+             std::chrono::duration<double, std::nano>(sortTime).count() / samples);
+    TEST_MESSAGE(message);
+  }
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_median_matches_sort);
+  RUN_TEST(test_trimmed_mean_matches_sort);
+  RUN_TEST(test_duplicates);
+  RUN_TEST(test_float);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include "RingLog.h"
+
+using util::RingLog;
+
+void setUp() {}
+void tearDown() {}
+
+static void test_indexing() {
+  RingLog<uint32_t, 8> ring;
+  uint32_t value;
+  TEST_ASSERT_EQUAL_UINT32(0, ring.count());
+  TEST_ASSERT_EQUAL_UINT32(0, ring.tail());
+  TEST_ASSERT_FALSE(ring.read(0, value));
+  for (uint32_t i = 0; i < 5; i++) ring.push(100 + i);
+  TEST_ASSERT_EQUAL_UINT32(5, ring.count());
+  TEST_ASSERT_EQUAL_UINT32(0, ring.tail());
+  for (uint32_t i = 0; i < 5; i++) {
+    TEST_ASSERT_TRUE(ring.read(i, value));
+    TEST_ASSERT_EQUAL_UINT32(100 + i, value);
+  }
+  TEST_ASSERT_FALSE(ring.read(5, value));
+  // one slot is kept as a guard, so N - 1 entries are readable
+  for (uint32_t i = 5; i < 20; i++) ring.push(100 + i);
+  TEST_ASSERT_EQUAL_UINT32(13, ring.tail());
+  TEST_ASSERT_FALSE(ring.read(12, value));
+  for (uint32_t i = 13; i < 20; i++) {
+    TEST_ASSERT_TRUE(ring.read(i, value));
+    TEST_ASSERT_EQUAL_UINT32(100 + i, value);
+  }
+}
+
+/*
+  One producer pushes entries whose words all hold the entry index, while readers follow with their own cursor and
+  skip to tail() when lapped. Any read that succeeds must return a whole entry with the requested index.
+*/
+static void test_concurrent_readers() {
+  constexpr const uint32_t pushes = 20000000;
+  constexpr const int readers = 4;
+  struct Entry {
+    uint32_t words[8];
+  };
+  static RingLog<Entry, 64> ring;
+  std::atomic<bool> stop{false};
+  std::atomic<uint32_t> started{0}, reads{0}, lapped{0}, torn{0};
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++)
+    threads.emplace_back([&]() {
+      started++;
+      for (uint32_t cursor = 0; !stop;) {
+        if (cursor == ring.count()) continue;
+        Entry entry;
+        if (!ring.read(cursor, entry)) {
+          cursor = ring.tail();
+          lapped++;
+          continue;
+        }
+        for (auto word : entry.words)
+          if (word != cursor) {
+            torn++;
+            break;
+          }
+        cursor++;
+        reads++;
+      }
+    });
+  while (started != readers) std::this_thread::yield();
+  for (uint32_t i = 0; i < pushes; i++) {
+    Entry entry;
+    for (auto &word : entry.words) word = i;
+    ring.push(entry);
+  }
+  stop = true;
+  for (auto &thread : threads) thread.join();
+  char message[128];
+  snprintf(message, sizeof(message), "pushes %u reads %u lapped %u torn %u", pushes, uint32_t(reads), uint32_t(lapped),
+           uint32_t(torn));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_TRUE(reads > 0);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_indexing);
+  RUN_TEST(test_concurrent_readers);
+  return UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unity.h>
+#include "SettlingPredictor.h"
+
+using blastic::scale::SettlingPredictor;
+
+/*
+  Step response corpus: a load of finalWeight applied at t = 0 and sampled at 80 Hz, as an exponential approach or a
+  damped oscillation, plus gaussian noise. With the default configuration, each response has acceptance numbers for
+  the worst error of any confident prediction and for the time of the first one (time to estimate). The time at
+  which the raw signal stays within 0.05 of the final weight is reported for comparison.
+
+  Oscillations and fast exponentials are estimated well before the raw signal settles. On slow exponentials the
+  curvature within the fit window is comparable to the noise, so the estimate comes late and, for a 1 s time
+  constant, is biased towards the current reading beyond its uncertainty.
+*/
+
+struct StepResponse {
+  const char *name;
+  float finalWeight, tau, frequency, damping, noise;
+  // acceptance numbers
+  float maxError, maxTimeToEstimate;
+
+  float at(float t) const {
+    if (frequency > 0) return finalWeight * (1 - expf(-t / damping) * cosf(2 * float(M_PI) * frequency * t));
+    return finalWeight * (1 - expf(-t / tau));
+  }
+};
+
+static const StepResponse corpus[] = {
+    {"exponential 20kg tau 0.2s", 20, 0.2, 0, 0, 0.002, 0.03, 0.75},
+    {"exponential 5kg tau 0.5s", 5, 0.5, 0, 0, 0.002, 0.05, 2.4},
+    {"exponential 1kg tau 1s", 1, 1, 0, 0, 0.001, 0.1, 2.4},
+    {"oscillation 20kg 3Hz damping 0.4s", 20, 0, 3, 0.4, 0.002, 0.02, 0.4},
+    {"oscillation 10kg 5Hz damping 0.3s", 10, 0, 5, 0.3, 0.002, 0.01, 0.3},
+    {"oscillation 2kg 2Hz damping 0.6s", 2, 0, 2, 0.6, 0.001, 0.05, 2.1},
+};
+
+constexpr const SettlingPredictor::EEPROMConfig config{.window = 24, .maxUncertainty = 0.02};
+constexpr const float sampleMillis = 12.5, settledError = 0.05;
+constexpr const int samples = 400;
+
+void setUp() {}
+void tearDown() {}
+
+static void test_corpus() {
+  std::mt19937 generator(1);
+  for (auto &response : corpus) {
+    std::normal_distribution<float> noise(0, response.noise);
+    SettlingPredictor predictor;
+    float firstEstimate = NAN, settled = 0, worstError = 0;
+    for (int n = 0; n < samples; n++) {
+      const float t = n * sampleMillis / 1000, y = response.at(t) + noise(generator);
+      if (fabsf(y - response.finalWeight) > settledError) settled = t + sampleMillis / 1000;
+      if (!predictor.update(config, y, TickType_t(lroundf(n * sampleMillis)))) continue;
+      if (std::isnan(firstEstimate)) firstEstimate = t;
+      worstError = fmaxf(worstError, fabsf(predictor.prediction() - response.finalWeight));
+    }
+    char message[160];
+    snprintf(message, sizeof(message), "%s: first estimate %.3fs, raw settled %.3fs, worst error %.4f",
+             response.name, firstEstimate, settled, worstError);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_FALSE_MESSAGE(std::isnan(firstEstimate), response.name);
+    TEST_ASSERT_TRUE_MESSAGE(firstEstimate <= response.maxTimeToEstimate, response.name);
+    TEST_ASSERT_TRUE_MESSAGE(worstError <= response.maxError, response.name);
+  }
+}
+
+// a constant load must be confirmed as soon as the window fills
+static void test_constant() {
+  std::mt19937 generator(1);
+  std::normal_distribution<float> noise(0, 0.002);
+  SettlingPredictor predictor;
+  int n = 0;
+  while (!predictor.update(config, 3 + noise(generator), TickType_t(lroundf(n * sampleMillis)))) n++;
+  TEST_ASSERT_EQUAL_INT(config.window - 1, n);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 3, predictor.prediction());
+}
+
+// gaps in the acquisition and invalid readings restart the window
+static void test_gap_resets() {
+  SettlingPredictor predictor;
+  TickType_t tick = 0;
+  for (int n = 0; n < config.window; n++, tick += 12) predictor.update(config, 1 + 0.001f * (n % 3), tick);
+  TEST_ASSERT_TRUE(predictor.confident());
+  TEST_ASSERT_FALSE(predictor.update(config, 1, tick + SettlingPredictor::maxGapMillis + 1));
+  TEST_ASSERT_FALSE(predictor.confident());
+  TEST_ASSERT_FALSE(predictor.update(config, NAN, tick + SettlingPredictor::maxGapMillis + 13));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_corpus);
+  RUN_TEST(test_constant);
+  RUN_TEST(test_gap_resets);
+  return UNITY_END();
+}